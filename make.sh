@@ -1,5 +1,10 @@
 astyle -A3 -s4 -f -xn -xc -xl -xC100 -O ./src/* && rm ./src/*.orig
 W="-Wfatal-errors -Wall -Wextra -Wshadow"
 O="-O3 -flto -march=native -DNDEBUG"
-g++ -std=c++11 $W $O -o $1 ./src/*.cc -lpthread
+C="-fconstexpr-ops-limit=1000000000"    # slider attack tables are calculated at compile time
+for opt in "${@:2}"; do
+    [ "$opt" = "pext" ] && O="$O -mbmi2 -DPEXT"    # BMI2 slider attacks: ./make.sh demolito pext
+    [ "$opt" = "attacks" ] && O="$O -DATTACK_COUNTS"    # incremental attack counts in Position
+done
+g++ -std=c++14 $W $O $C -o $1 ./src/*.cc -lpthread
 strip $1
@@ -14,183 +14,249 @@
  * not, see <http://www.gnu.org/licenses/>.
 */
 #include <iostream>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "bitboard.h"
 
 namespace {
 
-const int PDir[2][2] = {{1,-1},{1,1}};
-const int NDir[8][2] = {{-2,-1},{-2,1},{-1,-2},{-1,2},{1,-2},{1,2},{2,-1},{2,1}};
-const int KDir[8][2] = {{-1,-1},{-1,0},{-1,1},{0,-1},{0,1},{1,-1},{1,0},{1,1}};
+constexpr int PDir[2][2] = {{1,-1},{1,1}};
+constexpr int NDir[8][2] = {{-2,-1},{-2,1},{-1,-2},{-1,2},{1,-2},{1,2},{2,-1},{2,1}};
+constexpr int KDir[8][2] = {{-1,-1},{-1,0},{-1,1},{0,-1},{0,1},{1,-1},{1,0},{1,1}};
 
-bitboard_t PAttacks[NB_COLOR][NB_SQUARE];
-bitboard_t NAttacks[NB_SQUARE];
-bitboard_t KAttacks[NB_SQUARE];
+// All tables are calculated at compile time, and live in read-only memory
+struct Tables {
+    bitboard_t PAttacks[NB_COLOR][NB_SQUARE];
+    bitboard_t NAttacks[NB_SQUARE];
+    bitboard_t KAttacks[NB_SQUARE];
 
-bitboard_t BPseudoAttacks[NB_SQUARE];
-bitboard_t RPseudoAttacks[NB_SQUARE];
+    bitboard_t BPseudoAttacks[NB_SQUARE];
+    bitboard_t RPseudoAttacks[NB_SQUARE];
 
-bitboard_t Segment[NB_SQUARE][NB_SQUARE];
-bitboard_t Ray[NB_SQUARE][NB_SQUARE];
+    bitboard_t Segment[NB_SQUARE][NB_SQUARE];
+    bitboard_t Ray[NB_SQUARE][NB_SQUARE];
 
-bitboard_t PawnSpan[NB_COLOR][NB_SQUARE];
-bitboard_t PawnPath[NB_COLOR][NB_SQUARE];
-bitboard_t AdjacentFiles[NB_FILE];
-int KingDistance[NB_SQUARE][NB_SQUARE];
+    bitboard_t PawnSpan[NB_COLOR][NB_SQUARE];
+    bitboard_t PawnPath[NB_COLOR][NB_SQUARE];
+    bitboard_t AdjacentFiles[NB_FILE];
+    int KingDistance[NB_SQUARE][NB_SQUARE];
+};
 
-void safe_set_bit(bitboard_t& b, Rank r, File f)
+constexpr bool on_board(int r, int f)
 {
-    if (0 <= r && r < NB_RANK && 0 <= f && f < NB_FILE)
-        bb::set(b, square(r, f));
+    return 0 <= r && r < NB_RANK && 0 <= f && f < NB_FILE;
 }
 
-void init_leaper_attacks()
+constexpr bitboard_t safe_bit(int r, int f)
+{
+    return on_board(r, f) ? 1ULL << (NB_FILE * r + f) : 0;
+}
+
+constexpr void init_leaper_attacks(Tables& t)
 {
     for (Square s = A1; s <= H8; ++s) {
-        const Rank r = rank_of(s);
-        const File f = file_of(s);
+        const int r = s / NB_FILE;
+        const int f = s % NB_FILE;
 
         for (int d = 0; d < 8; d++) {
-            safe_set_bit(NAttacks[s], r + NDir[d][0], f + NDir[d][1]);
-            safe_set_bit(KAttacks[s], r + KDir[d][0], f + KDir[d][1]);
+            t.NAttacks[s] |= safe_bit(r + NDir[d][0], f + NDir[d][1]);
+            t.KAttacks[s] |= safe_bit(r + KDir[d][0], f + KDir[d][1]);
         }
 
         for (int d = 0; d < 2; d++) {
-            safe_set_bit(PAttacks[WHITE][s], r + PDir[d][0], f + PDir[d][1]);
-            safe_set_bit(PAttacks[BLACK][s], r - PDir[d][0], f - PDir[d][1]);
+            t.PAttacks[WHITE][s] |= safe_bit(r + PDir[d][0], f + PDir[d][1]);
+            t.PAttacks[BLACK][s] |= safe_bit(r - PDir[d][0], f - PDir[d][1]);
         }
     }
 }
 
-void init_eval()
+constexpr void init_eval(Tables& t)
 {
     for (Square s = H8; s >= A1; --s) {
-        if (rank_of(s) == RANK_8)
-            PawnSpan[WHITE][s] = PawnPath[WHITE][s] = 0;
+        if (s / NB_FILE == RANK_8)
+            t.PawnSpan[WHITE][s] = t.PawnPath[WHITE][s] = 0;
         else {
-            PawnSpan[WHITE][s] = PAttacks[WHITE][s] | PawnSpan[WHITE][s + UP];
-            PawnPath[WHITE][s] = (1ULL << (s + UP)) | PawnPath[WHITE][s + UP];
+            t.PawnSpan[WHITE][s] = t.PAttacks[WHITE][s] | t.PawnSpan[WHITE][s + UP];
+            t.PawnPath[WHITE][s] = (1ULL << (s + UP)) | t.PawnPath[WHITE][s + UP];
         }
     }
 
     for (Square s = A1; s <= H8; ++s) {
-        if (rank_of(s) == RANK_1)
-            PawnSpan[BLACK][s] = PawnPath[BLACK][s] = 0;
+        if (s / NB_FILE == RANK_1)
+            t.PawnSpan[BLACK][s] = t.PawnPath[BLACK][s] = 0;
         else {
-            PawnSpan[BLACK][s] = PAttacks[BLACK][s] | PawnSpan[BLACK][s + DOWN];
-            PawnPath[BLACK][s] = (1ULL << (s + DOWN)) | PawnPath[BLACK][s + DOWN];
+            t.PawnSpan[BLACK][s] = t.PAttacks[BLACK][s] | t.PawnSpan[BLACK][s + DOWN];
+            t.PawnPath[BLACK][s] = (1ULL << (s + DOWN)) | t.PawnPath[BLACK][s + DOWN];
         }
     }
 
     for (File f = FILE_A; f <= FILE_H; ++f)
-        AdjacentFiles[f] = (f > FILE_A ? bb::file(f - 1) : 0)
-                           | (f < FILE_H ? bb::file(f + 1) : 0);
+        t.AdjacentFiles[f] = (f > FILE_A ? 0x0101010101010101ULL << (f - 1) : 0)
+                             | (f < FILE_H ? 0x0101010101010101ULL << (f + 1) : 0);
 
     for (Square s1 = A1; s1 <= H8; ++s1)
-        for (Square s2 = A1; s2 <= H8; ++s2)
-            KingDistance[s1][s2] = std::max(std::abs(rank_of(s1) - rank_of(s2)),
-                                            std::abs(file_of(s1) - file_of(s2)));
+        for (Square s2 = A1; s2 <= H8; ++s2) {
+            const int dr = s1 / NB_FILE - s2 / NB_FILE, df = s1 % NB_FILE - s2 % NB_FILE;
+            const int ar = dr < 0 ? -dr : dr, af = df < 0 ? -df : df;
+            t.KingDistance[s1][s2] = ar > af ? ar : af;
+        }
 }
 
-void init_rays()
+constexpr void init_rays(Tables& t)
 {
     for (Square s1 = A1; s1 <= H8; ++s1) {
-        const Rank r1 = rank_of(s1);
-        const File f1 = file_of(s1);
+        const int r1 = s1 / NB_FILE;
+        const int f1 = s1 % NB_FILE;
 
         for (int d = 0; d < 8; d++) {
             bitboard_t mask = 0;
-            Rank r2 = r1;
-            File f2 = f1;
+            int r2 = r1, f2 = f1;
 
-            while (0 <= r2 && r2 < NB_RANK && 0 <= f2 && f2 < NB_FILE) {
-                const Square s2 = square(r2, f2);
-                bb::set(mask, s2);
-                Segment[s1][s2] = mask;
+            while (on_board(r2, f2)) {
+                const int s2 = NB_FILE * r2 + f2;
+                mask |= 1ULL << s2;
+                t.Segment[s1][s2] = mask;
                 r2 += KDir[d][0], f2 += KDir[d][1];
             }
 
-            bitboard_t sqs = mask;
+            for (int s2 = 0; s2 < NB_SQUARE; s2++)
+                if (mask & (1ULL << s2))
+                    t.Ray[s1][s2] = mask;
 
-            while (sqs) {
-                Square s2 = bb::pop_lsb(sqs);
-                Ray[s1][s2] = mask;
-            }
+            // Slider attacks on an empty board (mask includes s1 itself)
+            if (KDir[d][0] && KDir[d][1])
+                t.BPseudoAttacks[s1] |= mask ^ (1ULL << s1);
+            else
+                t.RPseudoAttacks[s1] |= mask ^ (1ULL << s1);
         }
     }
 }
 
-void init_slider_pseudo_attacks()
+constexpr Tables init()
 {
-    for (Square s = A1; s <= H8; ++s) {
-        BPseudoAttacks[s] = bb::battacks(s, 0);
-        RPseudoAttacks[s] = bb::rattacks(s, 0);
-    }
+    Tables t {};
+    init_rays(t);
+    init_leaper_attacks(t);
+    init_eval(t);
+    return t;
 }
 
-}    // namespace
+constexpr Tables T = init();
 
-namespace bb {
+const bitboard_t NotFileA = ~0x0101010101010101ULL, NotFileH = ~0x8080808080808080ULL;
+
+// Directions for occluded fills: shift increment, and mask excluding the file that the shift
+// wraps into. The first two directions go up the board, the last two go down.
+const int RShifts[4] = {UP, RIGHT, DOWN, LEFT};
+const bitboard_t RMasks[4] = {~0ULL, NotFileA, ~0ULL, NotFileH};
+const int BShifts[4] = {UP + RIGHT, UP + LEFT, DOWN + RIGHT, DOWN + LEFT};
+const bitboard_t BMasks[4] = {NotFileA, NotFileH, NotFileA, NotFileH};
 
-void init_slider_attacks();    // in magic.cc
+#ifdef __AVX2__
 
-void init()
+// Shift counts >= 64 produce zero, so each lane shifts either left (by l) or right (by r)
+__m256i shift4(__m256i v, __m256i l, __m256i r)
 {
-    init_rays();
-    init_leaper_attacks();
-    init_slider_attacks();
-    init_slider_pseudo_attacks();
-    init_eval();
+    return _mm256_or_si256(_mm256_sllv_epi64(v, l), _mm256_srlv_epi64(v, r));
 }
 
-/* Bitboard Accessors */
-
-bitboard_t rank(Rank r)
+// Kogge-Stone occluded fill, in 4 directions at once (one per 64-bit lane)
+bitboard_t occluded_attacks(bitboard_t fss, bitboard_t occ, const int shifts[4],
+                            const bitboard_t masks[4])
 {
-    BOUNDS(r, NB_RANK);
+    const __m256i mask = _mm256_setr_epi64x(masks[0], masks[1], masks[2], masks[3]);
+    const __m256i l1 = _mm256_setr_epi64x(shifts[0], shifts[1], 64, 64);
+    const __m256i r1 = _mm256_setr_epi64x(64, 64, -shifts[2], -shifts[3]);
+    __m256i l = l1, r = r1;
+    __m256i gen = _mm256_set1_epi64x(fss);
+    __m256i pro = _mm256_and_si256(_mm256_set1_epi64x(~occ), mask);
+
+    for (int i = 0; i < 3; i++) {
+        gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shift4(gen, l, r)));
+        pro = _mm256_and_si256(pro, shift4(pro, l, r));
+        l = _mm256_add_epi64(l, l);
+        r = _mm256_add_epi64(r, r);
+    }
 
-    return 0xFFULL << (8 * r);
+    gen = _mm256_and_si256(shift4(gen, l1, r1), mask);
+    const __m128i x = _mm_or_si128(_mm256_castsi256_si128(gen), _mm256_extracti128_si256(gen, 1));
+    return _mm_cvtsi128_si64(x) | _mm_extract_epi64(x, 1);
 }
 
-bitboard_t file(File f)
+#else
+
+// Kogge-Stone occluded fill, one direction at a time
+bitboard_t occluded_attacks(bitboard_t fss, bitboard_t occ, const int shifts[4],
+                            const bitboard_t masks[4])
 {
-    BOUNDS(f, NB_FILE);
+    bitboard_t result = 0;
+
+    for (int d = 0; d < 4; d++) {
+        const int i = shifts[d];
+        bitboard_t gen = fss, pro = ~occ & masks[d];
+        gen |= pro & bb::shift(gen, i);
+        pro &= bb::shift(pro, i);
+        gen |= pro & bb::shift(gen, 2 * i);
+        pro &= bb::shift(pro, 2 * i);
+        gen |= pro & bb::shift(gen, 4 * i);
+        result |= bb::shift(gen, i) & masks[d];
+    }
 
-    return 0x0101010101010101ULL << f;
+    return result;
 }
 
+#endif
+
+}    // namespace
+
+namespace bb {
+
+/* Bitboard Accessors */
+
 bitboard_t pattacks(Color c, Square s)
 {
     BOUNDS(s, NB_SQUARE);
 
-    return PAttacks[c][s];
+    return T.PAttacks[c][s];
 }
 
 bitboard_t nattacks(Square s)
 {
     BOUNDS(s, NB_SQUARE);
 
-    return NAttacks[s];
+    return T.NAttacks[s];
 }
 
 bitboard_t kattacks(Square s)
 {
     BOUNDS(s, NB_SQUARE);
 
-    return KAttacks[s];
+    return T.KAttacks[s];
 }
 
 bitboard_t bpattacks(Square s)
 {
     BOUNDS(s, NB_SQUARE);
 
-    return BPseudoAttacks[s];
+    return T.BPseudoAttacks[s];
 }
 
 bitboard_t rpattacks(Square s)
 {
     BOUNDS(s, NB_SQUARE);
 
-    return RPseudoAttacks[s];
+    return T.RPseudoAttacks[s];
+}
+
+bitboard_t battacks_all(bitboard_t fss, bitboard_t occ)
+{
+    return occluded_attacks(fss, occ, BShifts, BMasks);
+}
+
+bitboard_t rattacks_all(bitboard_t fss, bitboard_t occ)
+{
+    return occluded_attacks(fss, occ, RShifts, RMasks);
 }
 
 bitboard_t segment(Square s1, Square s2)
@@ -198,7 +264,7 @@ bitboard_t segment(Square s1, Square s2)
     BOUNDS(s1, NB_SQUARE);
     BOUNDS(s2, NB_SQUARE);
 
-    return Segment[s1][s2];
+    return T.Segment[s1][s2];
 }
 
 bitboard_t ray(Square s1, Square s2)
@@ -207,7 +273,7 @@ bitboard_t ray(Square s1, Square s2)
     BOUNDS(s2, NB_SQUARE);
     assert(s1 != s2);    // Ray[s][s] is undefined
 
-    return Ray[s1][s2];
+    return T.Ray[s1][s2];
 }
 
 bitboard_t pawn_span(Color c, Square s)
@@ -215,7 +281,7 @@ bitboard_t pawn_span(Color c, Square s)
     BOUNDS(c, NB_COLOR);
     BOUNDS(s, NB_SQUARE);
 
-    return PawnSpan[c][s];
+    return T.PawnSpan[c][s];
 }
 
 bitboard_t pawn_path(Color c, Square s)
@@ -223,14 +289,14 @@ bitboard_t pawn_path(Color c, Square s)
     BOUNDS(c, NB_COLOR);
     BOUNDS(s, NB_SQUARE);
 
-    return PawnPath[c][s];
+    return T.PawnPath[c][s];
 }
 
 bitboard_t adjacent_files(File f)
 {
     BOUNDS(f, NB_FILE);
 
-    return AdjacentFiles[f];
+    return T.AdjacentFiles[f];
 }
 
 int king_distance(Square s1, Square s2)
@@ -238,7 +304,7 @@ int king_distance(Square s1, Square s2)
     BOUNDS(s1, NB_SQUARE);
     BOUNDS(s2, NB_SQUARE);
 
-    return KingDistance[s1][s2];
+    return T.KingDistance[s1][s2];
 }
 
 /* Bit manipulation */
@@ -5,12 +5,21 @@ typedef uint64_t bitboard_t;
 
 namespace bb {
 
-void init();
-
 /* Bitboard Accessors */
 
-bitboard_t rank(Rank r);
-bitboard_t file(File f);
+constexpr bitboard_t rank(Rank r)
+{
+    BOUNDS(r, NB_RANK);
+
+    return 0xFFULL << (8 * r);
+}
+
+constexpr bitboard_t file(File f)
+{
+    BOUNDS(f, NB_FILE);
+
+    return 0x0101010101010101ULL << f;
+}
 
 // Leaper attacks
 bitboard_t pattacks(Color c, Square s);
@@ -22,6 +31,8 @@ bitboard_t battacks(Square s, bitboard_t occ);
 bitboard_t rattacks(Square s, bitboard_t occ);
 bitboard_t bpattacks(Square s);    // pseudo-attacks (empty board)
 bitboard_t rpattacks(Square s);    // pseudo-attacks (empty board)
+bitboard_t battacks_all(bitboard_t fss, bitboard_t occ);    // union over all squares in fss
+bitboard_t rattacks_all(bitboard_t fss, bitboard_t occ);    // union over all squares in fss
 
 bitboard_t segment(Square s1, Square s2);
 bitboard_t ray(Square s1, Square s2);
@@ -0,0 +1,270 @@
+/*
+ * Demolito, a UCI chess engine.
+ * Copyright 2015 lucasart.
+ *
+ * Demolito is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Demolito is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program. If
+ * not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>    // std::find
+#include <cstdlib>    // std::strtoull
+#include <thread>
+#include <fcntl.h>    // open()
+#include <sys/mman.h>    // mmap()
+#include <sys/stat.h>    // fstat()
+#include <unistd.h>    // close()
+#include "epd.h"
+#include "gen.h"
+
+namespace {
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Operation token: up to the next space or ';', or a whole "quoted string"
+const char *next_token(const char *p, const char *end, std::string& token)
+{
+    while (p != end && is_space(*p))
+        p++;
+
+    const char *begin = p;
+
+    if (p != end && *p == '"') {
+        begin = ++p;
+        p = std::find(p, end, '"');
+        token.assign(begin, p);
+        return p == end ? p : p + 1;
+    }
+
+    while (p != end && !is_space(*p) && *p != ';')
+        p++;
+
+    token.assign(begin, p);
+    return p;
+}
+
+}    // namespace
+
+namespace epd {
+
+File::File(const std::string& fileName) : _data(nullptr), _size(0), _open(false)
+{
+    const int fd = open(fileName.c_str(), O_RDONLY);
+
+    if (fd == -1)
+        return;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0) {
+        if (st.st_size == 0)
+            _open = true;    // nothing to map
+        else {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                _data = static_cast<const char *>(p);
+                _size = st.st_size;
+                _open = true;
+            }
+        }
+    }
+
+    close(fd);
+}
+
+File::~File()
+{
+    if (_data)
+        munmap(const_cast<char *>(_data), _size);
+}
+
+void for_each_line(const File& file, int threads,
+                   const std::function<void(int, const char *, const char *)>& f)
+{
+    if (!file.ok() || file.begin() == file.end())
+        return;
+
+    threads = std::max(threads, 1);
+
+    // Chunk boundaries, moved forward to the start of the next line
+    std::vector<const char *> bounds(threads + 1, file.end());
+    bounds[0] = file.begin();
+
+    for (int i = 1; i < threads; i++) {
+        const char *p = file.begin() + (file.end() - file.begin()) * i / threads;
+        p = std::max(p, bounds[i - 1]);
+        p = std::find(p, file.end(), '\n');
+        bounds[i] = p == file.end() ? p : p + 1;
+    }
+
+    const auto worker = [&](int threadId) {
+        const char *p = bounds[threadId], *end = bounds[threadId + 1];
+
+        while (p != end) {
+            const char *eol = std::find(p, end, '\n');
+
+            if (eol != p && !(eol == p + 1 && *p == '\r'))
+                f(threadId, p, eol);
+
+            p = eol == end ? eol : eol + 1;
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(worker, i);
+
+    worker(0);
+
+    for (auto& t : workers)
+        t.join();
+}
+
+const char *parse(const char *begin, const char *end, Position& pos, Ops *ops)
+{
+    const char *afterPos = pos.set(begin, end);
+
+    if (!ops)
+        return afterPos;
+
+    ops->bm.clear();
+    ops->am.clear();
+    ops->id.clear();
+    ops->c0.clear();
+    ops->perft.clear();
+
+    // Operations: "opcode operand ... ;"
+    const char *p = afterPos;
+    std::string opcode, operand;
+
+    while (p != end) {
+        p = next_token(p, end, opcode);
+
+        if (opcode.empty()) {
+            if (p != end)
+                p++;    // skip ';' (or stray ',')
+
+            continue;
+        }
+
+        while (true) {
+            p = next_token(p, end, operand);
+
+            if (operand.empty())
+                break;
+
+            Move m;
+
+            if ((opcode == "bm" || opcode == "am") && san_to_move(pos, operand, m))
+                (opcode == "bm" ? ops->bm : ops->am).push_back(compact(m));
+            else if (opcode == "id")
+                ops->id = operand;
+            else if (opcode == "c0")
+                ops->c0 = operand;
+            else if (opcode.size() >= 2 && opcode[0] == 'D' && isdigit(opcode[1])) {
+                // Malformed depth or count: skip the operation (we may be in a worker thread, so
+                // no exceptions)
+                char *depthEnd, *countEnd;
+                const uint64_t depth = std::strtoull(opcode.c_str() + 1, &depthEnd, 10);
+                const uint64_t count = std::strtoull(operand.c_str(), &countEnd, 10);
+
+                if (*depthEnd || depth > MAX_PLY || countEnd == operand.c_str() || *countEnd)
+                    continue;
+
+                if (ops->perft.size() <= depth)
+                    ops->perft.resize(depth + 1, 0);
+
+                ops->perft[depth] = count;
+            }
+        }
+    }
+
+    return afterPos;
+}
+
+bool san_to_move(const Position& pos, const std::string& san, Move& m)
+{
+    // Strip check, mate and annotation symbols
+    std::string s = san.substr(0, san.find_first_of("+#!?"));
+
+    bool sanOk = true, castling = false, kingSide = false;
+    Piece piece = PAWN, prom = NB_PIECE;
+    int fromFile = -1, fromRank = -1;
+    Square to = NB_SQUARE;
+
+    if (s == "O-O" || s == "0-0")
+        castling = kingSide = true;
+    else if (s == "O-O-O" || s == "0-0-0")
+        castling = true;
+    else {
+        // Promotion, with or without '='
+        const bool eq = s.size() >= 3 && s[s.size() - 2] == '=';
+
+        if (s.size() >= 3 && PieceLabel[WHITE].find(s.back()) <= size_t(QUEEN)
+                && isdigit(s[s.size() - 2 - eq])) {
+            prom = Piece(PieceLabel[WHITE].find(s.back()));
+            s.resize(s.size() - 1 - eq);
+        }
+
+        const size_t n = s.size();
+        size_t i = 0;
+
+        if (n >= 2 && 'a' <= s[n - 2] && s[n - 2] <= 'h' && '1' <= s[n - 1] && s[n - 1] <= '8') {
+            to = square(Rank(s[n - 1] - '1'), ::File(s[n - 2] - 'a'));
+
+            if (PieceLabel[WHITE].find(s[0]) <= size_t(KING))
+                piece = Piece(PieceLabel[WHITE].find(s[i++]));
+
+            // Disambiguation (file and/or rank), and capture symbol
+            for (; i < n - 2; i++) {
+                if ('a' <= s[i] && s[i] <= 'h')
+                    fromFile = s[i] - 'a';
+                else if ('1' <= s[i] && s[i] <= '8')
+                    fromRank = s[i] - '1';
+                else if (s[i] != 'x' && s[i] != '-')
+                    sanOk = false;
+            }
+        } else
+            sanOk = false;
+    }
+
+    MoveList list;
+    list.resize(gen::all_moves(pos, list.end()));
+    int matches = 0;
+
+    for (const smove_t em : list) {
+        const Move cand(em);
+        bool match;
+
+        if (cand.to_string() == san)
+            match = true;    // coordinate notation
+        else if (castling)
+            match = cand.is_castling() && (cand.to > cand.from) == kingSide;
+        else
+            match = sanOk && !cand.is_castling() && cand.piece == piece
+                    && cand.to == to && cand.prom == prom
+                    && (fromFile < 0 || file_of(cand.from) == fromFile)
+                    && (fromRank < 0 || rank_of(cand.from) == fromRank);
+
+        if (match) {
+            m = cand;
+            matches++;
+        }
+    }
+
+    return matches == 1;
+}
+
+}    // namespace epd
@@ -0,0 +1,45 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include "position.h"
+
+namespace epd {
+
+// Read-only memory mapping of a whole EPD or FEN file
+class File {
+    const char *_data;
+    size_t _size;
+    bool _open;
+public:
+    explicit File(const std::string& fileName);
+    ~File();
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    bool ok() const { return _open; }    // opened (possibly empty)
+    const char *begin() const { return _data; }
+    const char *end() const { return _data + _size; }
+};
+
+// EPD operations that we use: best moves, avoid moves, identifier, comment, and perft counts
+struct Ops {
+    std::vector<move16_t> bm, am;    // compact, like the best move of a search
+    std::string id, c0;
+    std::vector<uint64_t> perft;    // perft[d] from "Dd count" (0 if absent)
+};
+
+// Call f(threadId, begin, end) on every non empty line of the file. The file is split in one
+// chunk per thread, on line boundaries, so each thread sees its lines in file order, and lines
+// of thread i come before lines of thread i+1.
+void for_each_line(const File& file, int threads,
+                   const std::function<void(int, const char *, const char *)>& f);
+
+// Parse an EPD or FEN line into pos, and its operations into ops (if not null). Returns a
+// pointer past the position, eg. to the ",score" of a tuning file.
+const char *parse(const char *begin, const char *end, Position& pos, Ops *ops = nullptr);
+
+// Parse a move in SAN (or coordinate notation). Returns false if it is illegal or ambiguous.
+bool san_to_move(const Position& pos, const std::string& san, Move& m);
+
+}    // namespace epd
@@ -13,18 +13,28 @@
  * You should have received a copy of the GNU General Public License along with this program. If
  * not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>    // std::find, std::max, std::swap
 #include <iostream>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
 #include "gen.h"
 #include "move.h"
 #include "bitboard.h"
 
 namespace {
 
+// Moves from m.from (m.piece and m.type set by the caller) to tss
 template <bool Promotion>
-move_t *serialize_moves(Move& m, bitboard_t tss, move_t *emList, bool subPromotions = true)
+smove_t *serialize_moves(const Position& pos, Move& m, bitboard_t tss, smove_t *emList,
+                         bool subPromotions = true)
 {
     while (tss) {
         m.to = bb::pop_lsb(tss);
+        m.capture = pos.piece_on(m.to);
 
         if (Promotion) {
             if (subPromotions) {
@@ -41,140 +51,297 @@ move_t *serialize_moves(Move& m, bitboard_t tss, move_t *emList, bool subPromoti
     return emList;
 }
 
+// En passant can uncover a check on our king, through the two pawns leaving the same rank (or
+// through the captured pawn alone, on a diagonal).
+bool ep_is_legal(const Position& pos, Square from)
+{
+    const Color us = pos.turn(), them = ~us;
+    const Square king = king_square(pos, us), to = pos.ep_square();
+    bitboard_t occ = pieces(pos);
+    bb::clear(occ, from);
+    bb::set(occ, to);
+    bb::clear(occ, to + push_inc(them));
+    return !(bb::rattacks(king, occ) & pieces(pos, them, ROOK, QUEEN))
+           && !(bb::battacks(king, occ) & pieces(pos, them, BISHOP, QUEEN));
+}
+
+// Highest score in [begin, end). Scores are the odd 32-bit lanes: the even lanes (moves) are
+// blended with INT32_MIN before taking the lane-wise max.
+int max_score(const smove_t *begin, const smove_t *end)
+{
+    int result = INT32_MIN;
+
+#if defined(__AVX2__)
+    if (end - begin >= 8) {
+        const __m256i lowest = _mm256_set1_epi32(INT32_MIN);
+        __m256i acc = lowest;
+
+        for (; end - begin >= 4; begin += 4) {
+            const __m256i v = _mm256_loadu_si256((const __m256i *)begin);
+            acc = _mm256_max_epi32(acc, _mm256_blend_epi32(v, lowest, 0x55));
+        }
+
+        __m128i m = _mm_max_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        result = _mm_extract_epi32(m, 1);
+    }
+#elif defined(__SSE4_1__)
+    if (end - begin >= 8) {
+        const __m128i lowest = _mm_set1_epi32(INT32_MIN);
+        __m128i acc = lowest;
+
+        for (; end - begin >= 2; begin += 2) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)begin);
+            acc = _mm_max_epi32(acc, _mm_blend_epi16(v, lowest, 0x33));
+        }
+
+        acc = _mm_max_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        result = _mm_extract_epi32(acc, 1);
+    }
+#endif
+
+    for (; begin != end; begin++)
+        result = std::max(result, score_of(*begin));
+
+    return result;
+}
+
 }    // namespace
 
+size_t MoveList::sort(size_t begin, size_t limit)
+{
+    const size_t last = begin + std::min(limit, cnt - begin);
+
+    if (last == begin)
+        return last;
+
+    for (size_t i = begin + 1; i < cnt; i++) {
+        const smove_t sm = moves[i];
+        size_t j = i;
+
+        if (i >= last) {
+            // Sorted part full: sm must beat its worst move, which goes to the unsorted part
+            if (score_of(moves[last - 1]) >= score_of(sm))
+                continue;
+
+            moves[i] = moves[j = last - 1];
+        }
+
+        for (; j > begin && score_of(moves[j - 1]) < score_of(sm); j--)
+            moves[j] = moves[j - 1];
+
+        moves[j] = sm;
+    }
+
+    return last;
+}
+
+void MoveList::pick(size_t idx, size_t sorted)
+{
+    // moves[idx] is the best of the sorted part, so only the unsorted part needs a scan. Find
+    // its best score first (vectorized), then the first move with that score.
+    const smove_t *first = moves + std::max(sorted, idx + 1), *last = moves + cnt;
+
+    if (first >= last)
+        return;
+
+    const int best = max_score(first, last);
+
+    if (best > score_of(moves[idx])) {
+        while (score_of(*first) != best)
+            first++;
+
+        std::swap(moves[idx], moves[first - moves]);
+    }
+}
+
 namespace gen {
 
-move_t *pawn_moves(const Position& pos, move_t *emList, bitboard_t targets, bool subPromotions)
+template <Color Us>
+smove_t *pawn_moves(const Position& pos, smove_t *emList, bitboard_t targets,
+                    bool subPromotions)
 {
-    const Color us = pos.turn(), them = ~us;
-    const int push = push_inc(us);
-    const bitboard_t capturable = pos.by_color(them) | ep_square_bb(pos);
+    constexpr Color Them = ~Us;
+    constexpr int Push = Us == WHITE ? UP : DOWN;
+    constexpr bitboard_t Rank2 = bb::rank(Us == WHITE ? RANK_2 : RANK_7);
+    constexpr bitboard_t Rank7 = bb::rank(Us == WHITE ? RANK_7 : RANK_2);
+
+    const bitboard_t capturable = pos.by_color(Them) | ep_square_bb(pos);
+    const bitboard_t empty = ~pieces(pos);
+    const Square king = king_square(pos, Us);
+    const bitboard_t pins = pos.pins();
     bitboard_t fss, tss;
     Move m;
+    m.piece = PAWN;
 
     // Non promotions
-    fss = pieces(pos, us, PAWN) & ~bb::rank(relative_rank(us, RANK_7));
+    fss = pieces(pos, Us, PAWN) & ~Rank7;
 
     while (fss) {
         m.from = bb::pop_lsb(fss);
 
         // Calculate to squares: captures, single pushes and double pushes
-        tss = bb::pattacks(us, m.from) & capturable & targets;
+        tss = bb::pattacks(Us, m.from) & capturable & targets;
 
-        if (bb::test(~pieces(pos), m.from + push)) {
-            if (bb::test(targets, m.from + push))
-                bb::set(tss, m.from + push);
+        if (bb::test(empty, m.from + Push)) {
+            if (bb::test(targets, m.from + Push))
+                bb::set(tss, m.from + Push);
 
-            if (relative_rank(us, m.from) == RANK_2
-                    && bb::test(targets & ~pieces(pos), m.from + 2 * push))
-                bb::set(tss, m.from + 2 * push);
+            if (bb::test(Rank2, m.from) && bb::test(targets & empty, m.from + 2 * Push))
+                bb::set(tss, m.from + 2 * Push);
         }
 
-        // Generate moves
+        // Legality: pinned pawns move along the pin ray, and en passant must not uncover a check
+        if (bb::test(pins, m.from))
+            tss &= bb::ray(king, m.from);
+
         m.prom = NB_PIECE;
-        emList = serialize_moves<false>(m, tss, emList);
+
+        if (tss & ep_square_bb(pos)) {
+            tss &= ~ep_square_bb(pos);
+
+            if (ep_is_legal(pos, m.from)) {
+                m.to = pos.ep_square();
+                m.type = EN_PASSANT;
+                m.capture = PAWN;
+                *emList++ = m;
+            }
+        }
+
+        // Generate moves
+        m.type = NORMAL;
+        emList = serialize_moves<false>(pos, m, tss, emList);
     }
 
     // Promotions
-    fss = pieces(pos, us, PAWN) & bb::rank(relative_rank(us, RANK_7));
+    fss = pieces(pos, Us, PAWN) & Rank7;
 
     while (fss) {
         m.from = bb::pop_lsb(fss);
 
         // Calculate to squares: captures and single pushes
-        tss = bb::pattacks(us, m.from) & capturable & targets;
+        tss = bb::pattacks(Us, m.from) & capturable & targets;
+
+        if (bb::test(targets & empty, m.from + Push))
+            bb::set(tss, m.from + Push);
 
-        if (bb::test(targets & ~pieces(pos), m.from + push))
-            bb::set(tss, m.from + push);
+        if (bb::test(pins, m.from))
+            tss &= bb::ray(king, m.from);
 
-        // Generate moves (or promotions)
-        emList = serialize_moves<true>(m, tss, emList, subPromotions);
+        // Generate promotions
+        m.type = PROMOTION;
+        emList = serialize_moves<true>(pos, m, tss, emList, subPromotions);
     }
 
     return emList;
 }
 
-move_t *piece_moves(const Position& pos, move_t *emList, bitboard_t targets, bool kingMoves)
+template <Color Us>
+smove_t *piece_moves(const Position& pos, smove_t *emList, bitboard_t targets,
+                     bool kingMoves)
 {
-    const Color us = pos.turn();
+    const Square king = king_square(pos, Us);
+    const bitboard_t pins = pos.pins();
     bitboard_t fss, tss;
 
     Move m;
     m.prom = NB_PIECE;
+    m.type = NORMAL;
 
-    // King moves
+    // King moves: do not land on an attacked square
     if (kingMoves) {
-        m.from = king_square(pos, us);
-        tss = bb::kattacks(m.from) & targets;
-        emList = serialize_moves<false>(m, tss, emList);
+        m.from = king;
+        m.piece = KING;
+        tss = bb::kattacks(m.from) & targets & ~pos.attacked();
+        emList = serialize_moves<false>(pos, m, tss, emList);
     }
 
-    // Knight moves
-    fss = pieces(pos, us, KNIGHT);
+    // Knight moves (a pinned knight can never move)
+    fss = pieces(pos, Us, KNIGHT) & ~pins;
+    m.piece = KNIGHT;
 
     while (fss) {
         m.from = bb::pop_lsb(fss);
         tss = bb::nattacks(m.from) & targets;
-        emList = serialize_moves<false>(m, tss, emList);
+        emList = serialize_moves<false>(pos, m, tss, emList);
     }
 
     // Rook moves
-    fss = pieces(pos, us, ROOK, QUEEN);
+    fss = pieces(pos, Us, ROOK, QUEEN);
 
     while (fss) {
         m.from = bb::pop_lsb(fss);
+        m.piece = pos.piece_on(m.from);
         tss = bb::rattacks(m.from, pieces(pos)) & targets;
-        emList = serialize_moves<false>(m, tss, emList);
+
+        if (bb::test(pins, m.from))
+            tss &= bb::ray(king, m.from);
+
+        emList = serialize_moves<false>(pos, m, tss, emList);
     }
 
     // Bishop moves
-    fss = pieces(pos, us, BISHOP, QUEEN);
+    fss = pieces(pos, Us, BISHOP, QUEEN);
 
     while (fss) {
         m.from = bb::pop_lsb(fss);
+        m.piece = pos.piece_on(m.from);
         tss = bb::battacks(m.from, pieces(pos)) & targets;
-        emList = serialize_moves<false>(m, tss, emList);
+
+        if (bb::test(pins, m.from))
+            tss &= bb::ray(king, m.from);
+
+        emList = serialize_moves<false>(pos, m, tss, emList);
     }
 
     return emList;
 }
 
-move_t *castling_moves(const Position& pos, move_t *emList)
+template <Color Us>
+smove_t *castling_moves(const Position& pos, smove_t *emList)
 {
     assert(!pos.checkers());
+    const Rank r = Us == WHITE ? RANK_1 : RANK_8;
     Move m;
-    m.from = king_square(pos, pos.turn());
+    m.from = king_square(pos, Us);
     m.prom = NB_PIECE;
+    m.type = CASTLING;
+    m.piece = KING;
+    m.capture = NB_PIECE;
 
-    bitboard_t tss = pos.castlable_rooks() & pos.by_color(pos.turn());
+    bitboard_t tss = pos.castlable_rooks() & pos.by_color(Us);
 
     while (tss) {
         m.to = bb::pop_lsb(tss);
-        const Square kto = square(rank_of(m.to), m.to > m.from ? FILE_G : FILE_C);
-        const Square rto = square(rank_of(m.to), m.to > m.from ? FILE_F : FILE_D);
+        const Square kto = square(r, m.to > m.from ? FILE_G : FILE_C);
+        const Square rto = square(r, m.to > m.from ? FILE_F : FILE_D);
         const bitboard_t s = bb::segment(m.from, kto) | bb::segment(m.to, rto);
 
-        if (bb::count(s & pieces(pos)) == 2)
+        // The king must not go through an attacked square, and the rook must not be pinned
+        if (bb::count(s & pieces(pos)) == 2 && !(pos.attacked() & bb::segment(m.from, kto))
+                && !bb::test(pos.pins(), m.to))
             *emList++ = m;
     }
 
     return emList;
 }
 
-move_t *check_escapes(const Position& pos, move_t *emList, bool subPromotions)
+template <Color Us>
+smove_t *check_escapes(const Position& pos, smove_t *emList, bool subPromotions)
 {
     assert(pos.checkers());
-    bitboard_t ours = pos.by_color(pos.turn());
-    const Square king = king_square(pos, pos.turn());
+    bitboard_t ours = pos.by_color(Us);
+    const Square king = king_square(pos, Us);
     bitboard_t tss;
     Move m;
 
     // King moves
-    tss = bb::kattacks(king) & ~ours;
+    tss = bb::kattacks(king) & ~ours & ~pos.attacked();
     m.from = king;
     m.prom = NB_PIECE;
-    emList = serialize_moves<false>(m, tss, emList);
+    m.type = NORMAL;
+    m.piece = KING;
+    emList = serialize_moves<false>(pos, m, tss, emList);
 
     if (!bb::several(pos.checkers())) {
         // Single checker
@@ -187,7 +354,7 @@ move_t *check_escapes(const Position& pos, move_t *emList, bool subPromotions)
               ? bb::segment(king, checkerSquare)
               : pos.checkers();
 
-        emList = piece_moves(pos, emList, tss & ~ours, false);
+        emList = piece_moves<Us>(pos, emList, tss & ~ours, false);
 
         // if checked by a Pawn and epsq is available, then the check must result from a
         // pawn double push, and we also need to consider capturing it en-passant to solve
@@ -195,27 +362,187 @@ move_t *check_escapes(const Position& pos, move_t *emList, bool subPromotions)
         if (checkerPiece == PAWN && pos.ep_square() < NB_SQUARE)
             bb::set(tss, pos.ep_square());
 
-        emList = pawn_moves(pos, emList, tss, subPromotions);
+        emList = pawn_moves<Us>(pos, emList, tss, subPromotions);
     }
 
     return emList;
 }
 
-move_t *all_moves(const Position& pos, move_t *emList)
+template <Color Us>
+smove_t *quiet_checks(const Position& pos, smove_t *emList)
+{
+    assert(!pos.checkers());
+    constexpr Color Them = ~Us;
+    const Square king = king_square(pos, Us), theirKing = king_square(pos, Them);
+    const bitboard_t occ = pieces(pos), empty = ~occ, pins = pos.pins();
+    bitboard_t fss, tss;
+    Move m;
+
+    // Our pieces that block one of our sliders from their king: moving them off that line
+    // gives a discovered check
+    bitboard_t discoverers = 0;
+    bitboard_t sliders = (pieces(pos, Us, ROOK, QUEEN) & bb::rpattacks(theirKing))
+                         | (pieces(pos, Us, BISHOP, QUEEN) & bb::bpattacks(theirKing));
+
+    while (sliders) {
+        const Square s = bb::pop_lsb(sliders);
+        const bitboard_t b = bb::segment(theirKing, s) & occ & ~(1ULL << s) & ~(1ULL << theirKing);
+
+        if (!bb::several(b) && (b & pos.by_color(Us)))
+            discoverers |= b;
+    }
+
+    // Quiet moves to tss, that give check, and are legal
+    const auto serialize_checks = [&](bitboard_t checks) {
+        if (bb::test(discoverers, m.from))
+            checks |= ~bb::ray(theirKing, m.from);
+
+        if (bb::test(pins, m.from))
+            checks &= bb::ray(king, m.from);
+
+        emList = serialize_moves<false>(pos, m, tss & checks, emList);
+    };
+
+    m.prom = NB_PIECE;
+    m.type = NORMAL;
+
+    // Piece moves: direct checks land on squares attacking their king
+    for (Piece p = KNIGHT; p <= QUEEN; ++p) {
+        const bitboard_t checks = piece_attacks(Them, p, theirKing, occ);
+        fss = pieces(pos, Us, p);
+        m.piece = p;
+
+        while (fss) {
+            m.from = bb::pop_lsb(fss);
+            tss = piece_attacks(Us, p, m.from, occ) & empty;
+            serialize_checks(checks);
+        }
+    }
+
+    // King moves: only discovered checks
+    if (bb::test(discoverers, king)) {
+        m.from = king;
+        m.piece = KING;
+        tss = bb::kattacks(king) & empty & ~pos.attacked();
+        serialize_checks(0);
+    }
+
+    // Pawn pushes, except promotions (not quiet moves)
+    constexpr int Push = Us == WHITE ? UP : DOWN;
+    constexpr bitboard_t Rank2 = bb::rank(Us == WHITE ? RANK_2 : RANK_7);
+    constexpr bitboard_t Rank7 = bb::rank(Us == WHITE ? RANK_7 : RANK_2);
+    fss = pieces(pos, Us, PAWN) & ~Rank7;
+    m.piece = PAWN;
+
+    while (fss) {
+        m.from = bb::pop_lsb(fss);
+        tss = 0;
+
+        if (bb::test(empty, m.from + Push)) {
+            bb::set(tss, m.from + Push);
+
+            if (bb::test(Rank2, m.from) && bb::test(empty, m.from + 2 * Push))
+                bb::set(tss, m.from + 2 * Push);
+        }
+
+        serialize_checks(bb::pattacks(Them, theirKing));
+    }
+
+    return emList;
+}
+
+template <Color Us>
+smove_t *all_moves(const Position& pos, smove_t *emList)
 {
     if (pos.checkers())
-        return check_escapes(pos, emList);
+        return check_escapes<Us>(pos, emList);
     else {
-        bitboard_t targets = ~pos.by_color(pos.turn());
-        move_t *em = emList;
+        bitboard_t targets = ~pos.by_color(Us);
+        smove_t *em = emList;
 
-        em = pawn_moves(pos, em, targets);
-        em = piece_moves(pos, em, targets);
-        em = castling_moves(pos, em);
+        em = pawn_moves<Us>(pos, em, targets);
+        em = piece_moves<Us>(pos, em, targets);
+        em = castling_moves<Us>(pos, em);
         return em;
     }
 }
 
+template smove_t *pawn_moves<WHITE>(const Position&, smove_t *, bitboard_t, bool);
+template smove_t *pawn_moves<BLACK>(const Position&, smove_t *, bitboard_t, bool);
+template smove_t *piece_moves<WHITE>(const Position&, smove_t *, bitboard_t, bool);
+template smove_t *piece_moves<BLACK>(const Position&, smove_t *, bitboard_t, bool);
+template smove_t *castling_moves<WHITE>(const Position&, smove_t *);
+template smove_t *castling_moves<BLACK>(const Position&, smove_t *);
+template smove_t *check_escapes<WHITE>(const Position&, smove_t *, bool);
+template smove_t *check_escapes<BLACK>(const Position&, smove_t *, bool);
+template smove_t *quiet_checks<WHITE>(const Position&, smove_t *);
+template smove_t *quiet_checks<BLACK>(const Position&, smove_t *);
+template smove_t *all_moves<WHITE>(const Position&, smove_t *);
+template smove_t *all_moves<BLACK>(const Position&, smove_t *);
+
+// Runtime dispatch on the side to move
+
+smove_t *pawn_moves(const Position& pos, smove_t *emList, bitboard_t targets,
+                    bool subPromotions)
+{
+    return pos.turn() == WHITE ? pawn_moves<WHITE>(pos, emList, targets, subPromotions)
+           : pawn_moves<BLACK>(pos, emList, targets, subPromotions);
+}
+
+smove_t *piece_moves(const Position& pos, smove_t *emList, bitboard_t targets,
+                     bool kingMoves)
+{
+    return pos.turn() == WHITE ? piece_moves<WHITE>(pos, emList, targets, kingMoves)
+           : piece_moves<BLACK>(pos, emList, targets, kingMoves);
+}
+
+smove_t *castling_moves(const Position& pos, smove_t *emList)
+{
+    return pos.turn() == WHITE ? castling_moves<WHITE>(pos, emList)
+           : castling_moves<BLACK>(pos, emList);
+}
+
+smove_t *check_escapes(const Position& pos, smove_t *emList, bool subPromotions)
+{
+    return pos.turn() == WHITE ? check_escapes<WHITE>(pos, emList, subPromotions)
+           : check_escapes<BLACK>(pos, emList, subPromotions);
+}
+
+smove_t *quiet_checks(const Position& pos, smove_t *emList)
+{
+    return pos.turn() == WHITE ? quiet_checks<WHITE>(pos, emList)
+           : quiet_checks<BLACK>(pos, emList);
+}
+
+smove_t *all_moves(const Position& pos, smove_t *emList)
+{
+    return pos.turn() == WHITE ? all_moves<WHITE>(pos, emList) : all_moves<BLACK>(pos, emList);
+}
+
+bool is_legal(const Position& pos, Move m)
+{
+    const Color us = pos.turn();
+    const bitboard_t tss = 1ULL << m.to;
+    MoveList list;
+
+    if (!bb::test(pos.by_color(us), m.from))
+        return false;
+
+    // Generate the legal moves to m.to only, and look for m among them
+    if (pos.checkers())
+        list.resize(check_escapes(pos, list.end()));
+    else if (bb::test(pos.by_color(us), m.to))
+        list.resize(castling_moves(pos, list.end()));
+    else if (m.piece == PAWN)
+        list.resize(pawn_moves(pos, list.end(), tss));
+    else
+        // Common case: a piece move is legal if it is pseudo-legal and passes pseudo_is_legal()
+        return m.prom == NB_PIECE && (piece_attacks(us, m.piece, m.from, pieces(pos)) & tss)
+               && m.pseudo_is_legal(pos);
+
+    return std::find(list.begin(), list.end(), smove_t(move_t(m))) != list.end();
+}
+
 template <bool Root>
 uint64_t perft(const Position& pos, int depth)
 {
@@ -225,26 +552,123 @@ uint64_t perft(const Position& pos, int depth)
 
     uint64_t result = 0;
     Position after;
-    move_t emList[MAX_MOVES];
-    move_t *end = all_moves(pos, emList);
-
-    for (move_t *em = emList; em != end; em++) {
-        const Move m(*em);
+    MoveList list;
+    list.resize(all_moves(pos, list.end()));
 
-        if (!m.pseudo_is_legal(pos))
-            continue;
+    for (const smove_t em : list) {
+        const Move m(em);
+        assert(m.pseudo_is_legal(pos) && smove_t(Move(pos, compact(m))) == em);
 
         after.set(pos, m);
         const uint64_t sub_tree = perft<false>(after, depth - 1);
         result += sub_tree;
 
         if (Root)
-            std::cout << m.to_string(pos) << '\t' << sub_tree << std::endl;
+            std::cout << m.to_string() << '\t' << sub_tree << std::endl;
     }
 
     return result;
 }
 
 template uint64_t perft<true>(const Position& pos, int depth);
+template uint64_t perft<false>(const Position& pos, int depth);
+
+// Same as perft(), using make/unmake instead of copy-make. Slower, but useful to validate and
+// benchmark do_move() and undo_move().
+template <bool Root>
+uint64_t perft_undo(Position& pos, int depth)
+{
+    if (depth <= 0)
+        return 1;
+
+    uint64_t result = 0;
+    Undo u;
+    MoveList list;
+    list.resize(all_moves(pos, list.end()));
+
+    for (const smove_t em : list) {
+        const Move m(em);
+        assert(m.pseudo_is_legal(pos) && smove_t(Move(pos, compact(m))) == em);
+
+        pos.do_move(m, u);
+        const uint64_t sub_tree = perft_undo<false>(pos, depth - 1);
+        pos.undo_move(m, u);
+        result += sub_tree;
+
+        if (Root)
+            std::cout << m.to_string() << '\t' << sub_tree << std::endl;
+    }
+
+    return result;
+}
+
+template uint64_t perft_undo<true>(Position& pos, int depth);
+template uint64_t perft_undo<false>(Position& pos, int depth);
+
+namespace {
+
+// Shared by all perft threads, without locking: key is stored XOR data, so that an entry torn by
+// concurrent writes fails the key check.
+struct PerftEntry {
+    uint64_t keyXorData;
+    uint64_t data;    // count << 8 | depth
+};
+
+const size_t NbPerftEntry = 1 << 21;    // 32MB
+
+PerftEntry *perft_hash()
+{
+    static std::vector<PerftEntry> table(NbPerftEntry, {0, 0});    // allocated on first use
+    return table.data();
+}
+
+}    // namespace
+
+template <bool Root>
+uint64_t perft_fast(const Position& pos, int depth)
+{
+    if (depth <= 0)
+        return 1;
+
+    PerftEntry *e = nullptr;
+
+    if (!Root && depth >= 2) {
+        e = &perft_hash()[pos.key() & (NbPerftEntry - 1)];
+        const PerftEntry copy = *e;
+
+        if ((copy.keyXorData ^ copy.data) == pos.key() && (copy.data & 0xff) == uint64_t(depth))
+            return copy.data >> 8;
+    }
+
+    MoveList list;
+    list.resize(all_moves(pos, list.end()));
+
+    // Bulk counting: the moves are legal, so the leaves need not be played
+    if (depth == 1 && !Root)
+        return list.cnt;
+
+    uint64_t result = 0;
+    Position after;
+
+    for (const smove_t em : list) {
+        const Move m(em);
+        after.set(pos, m);
+        const uint64_t sub_tree = perft_fast<false>(after, depth - 1);
+        result += sub_tree;
+
+        if (Root)
+            std::cout << m.to_string() << '\t' << sub_tree << std::endl;
+    }
+
+    if (e) {
+        const uint64_t data = result << 8 | uint64_t(depth);
+        *e = {pos.key() ^ data, data};
+    }
+
+    return result;
+}
+
+template uint64_t perft_fast<true>(const Position& pos, int depth);
+template uint64_t perft_fast<false>(const Position& pos, int depth);
 
 }    // namespace gen
@@ -4,16 +4,66 @@
 
 #define MAX_MOVES 192
 
+// Scored move: the sort score in the high 32 bits, and the move_t in the low 32 bits. Generators
+// produce a zero score.
+typedef int64_t smove_t;
+
+inline smove_t scored(move_t em, int score) { return int64_t(score) * (1LL << 32) | em; }
+inline int score_of(smove_t sm) { return int(sm >> 32); }
+
+// Fixed capacity list of scored moves, filled by the generators below
+struct MoveList {
+    smove_t moves[MAX_MOVES];
+    size_t cnt = 0;
+
+    smove_t *begin() { return moves; }
+    smove_t *end() { return moves + cnt; }
+    void resize(const smove_t *last) { cnt = last - moves; }    // after generating to end()
+
+    // Bounded insertion sort: the best limit moves of moves[begin, cnt) go to the front, sorted
+    // (stable), and the others follow, unsorted. Returns the end of the sorted part. Meant for
+    // short lists, like captures.
+    size_t sort(size_t begin, size_t limit = MAX_MOVES);
+
+    // Swap the best move of moves[idx, cnt) (the first one, among equal scores) into moves[idx],
+    // given that moves[idx, sorted) is already sorted.
+    void pick(size_t idx, size_t sorted);
+};
+
 namespace gen {
 
-move_t *pawn_moves(const Position& pos, move_t *emList, bitboard_t targets,
-                   bool subPromotions = true);
-move_t *piece_moves(const Position& pos, move_t *emList, bitboard_t targets, bool kingMoves = true);
-move_t *castling_moves(const Position& pos, move_t *emList);
-move_t *check_escapes(const Position& pos, move_t *emList, bool subPromotions = true);
+// All generators produce legal moves only. The templates generate for a side to move known at
+// compile time, and the plain functions dispatch on pos.turn().
+template <Color Us> smove_t *pawn_moves(const Position& pos, smove_t *emList,
+                                        bitboard_t targets, bool subPromotions = true);
+template <Color Us> smove_t *piece_moves(const Position& pos, smove_t *emList,
+                                         bitboard_t targets, bool kingMoves = true);
+template <Color Us> smove_t *castling_moves(const Position& pos, smove_t *emList);
+template <Color Us> smove_t *check_escapes(const Position& pos, smove_t *emList,
+                                           bool subPromotions = true);
+template <Color Us> smove_t *quiet_checks(const Position& pos, smove_t *emList);
+template <Color Us> smove_t *all_moves(const Position& pos, smove_t *emList);
+
+smove_t *pawn_moves(const Position& pos, smove_t *emList, bitboard_t targets,
+                    bool subPromotions = true);
+smove_t *piece_moves(const Position& pos, smove_t *emList, bitboard_t targets,
+                     bool kingMoves = true);
+smove_t *castling_moves(const Position& pos, smove_t *emList);
+smove_t *check_escapes(const Position& pos, smove_t *emList, bool subPromotions = true);
 
-move_t *all_moves(const Position& pos, move_t *emList);
+smove_t *quiet_checks(const Position& pos, smove_t *emList);    // direct or discovered
+smove_t *all_moves(const Position& pos, smove_t *emList);
 
+// Is m a legal move? Works for any move, eg. from the TT (expanded with Move(pos, em)), without
+// generating all moves.
+bool is_legal(const Position& pos, Move m);
+
+// Root prints the divide (count per root move)
 template <bool Root=true> uint64_t perft(const Position& pos, int depth);
+template <bool Root=true> uint64_t perft_undo(Position& pos, int depth);
+
+// Fast perft, for movegen regression checks: counts the legal moves at depth 1 without playing
+// them, and caches subtree counts by (key, depth) in a dedicated hash table
+template <bool Root=true> uint64_t perft_fast(const Position& pos, int depth);
 
 }    // namespace gen
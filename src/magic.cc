@@ -13,11 +13,14 @@
  * You should have received a copy of the GNU General Public License along with this program. If
  * not, see <http://www.gnu.org/licenses/>.
 */
+#ifdef PEXT
+#include <immintrin.h>    // _pext_u64()
+#endif
 #include "bitboard.h"
 
 namespace {
 
-const int RShift[NB_SQUARE] = {
+constexpr int RShift[NB_SQUARE] = {
     52, 53, 53, 53, 53, 53, 53, 52,
     53, 54, 54, 54, 54, 54, 54, 53,
     53, 54, 54, 54, 54, 54, 54, 53,
@@ -28,7 +31,7 @@ const int RShift[NB_SQUARE] = {
     53, 54, 54, 53, 53, 53, 53, 53
 };
 
-const bitboard_t RMagic[NB_SQUARE] = {
+constexpr bitboard_t RMagic[NB_SQUARE] = {
     0x0080001020400080ull, 0x0040001000200040ull, 0x0080081000200080ull, 0x0080040800100080ull,
     0x0080020400080080ull, 0x0080010200040080ull, 0x0080008001000200ull, 0x0080002040800100ull,
     0x0000800020400080ull, 0x0000400020005000ull, 0x0000801000200080ull, 0x0000800800100080ull,
@@ -47,7 +50,7 @@ const bitboard_t RMagic[NB_SQUARE] = {
     0x0001000204080011ull, 0x0001000204000801ull, 0x0001000082000401ull, 0x0001FFFAABFAD1A2ull
 };
 
-const bitboard_t RMask[NB_SQUARE] = {
+constexpr bitboard_t RMask[NB_SQUARE] = {
     0x000101010101017Eull, 0x000202020202027Cull, 0x000404040404047Aull, 0x0008080808080876ull,
     0x001010101010106Eull, 0x002020202020205Eull, 0x004040404040403Eull, 0x008080808080807Eull,
     0x0001010101017E00ull, 0x0002020202027C00ull, 0x0004040404047A00ull, 0x0008080808087600ull,
@@ -66,7 +69,7 @@ const bitboard_t RMask[NB_SQUARE] = {
     0x6E10101010101000ull, 0x5E20202020202000ull, 0x3E40404040404000ull, 0x7E80808080808000ull
 };
 
-const int BShift[NB_SQUARE] = {
+constexpr int BShift[NB_SQUARE] = {
     58, 59, 59, 59, 59, 59, 59, 58,
     59, 59, 59, 59, 59, 59, 59, 59,
     59, 59, 57, 57, 57, 57, 59, 59,
@@ -77,7 +80,7 @@ const int BShift[NB_SQUARE] = {
     58, 59, 59, 59, 59, 59, 59, 58
 };
 
-const bitboard_t BMagic[NB_SQUARE] = {
+constexpr bitboard_t BMagic[NB_SQUARE] = {
     0x0002020202020200ull, 0x0002020202020000ull, 0x0004010202000000ull, 0x0004040080000000ull,
     0x0001104000000000ull, 0x0000821040000000ull, 0x0000410410400000ull, 0x0000104104104000ull,
     0x0000040404040400ull, 0x0000020202020200ull, 0x0000040102020000ull, 0x0000040400800000ull,
@@ -96,7 +99,7 @@ const bitboard_t BMagic[NB_SQUARE] = {
     0x0000000010020200ull, 0x0000000404080200ull, 0x0000040404040400ull, 0x0002020202020200ull
 };
 
-const bitboard_t BMask[NB_SQUARE] = {
+constexpr bitboard_t BMask[NB_SQUARE] = {
     0x0040201008040200ull, 0x0000402010080400ull, 0x0000004020100A00ull, 0x0000000040221400ull,
     0x0000000002442800ull, 0x0000000204085000ull, 0x0000020408102000ull, 0x0002040810204000ull,
     0x0020100804020000ull, 0x0040201008040000ull, 0x00004020100A0000ull, 0x0000004022140000ull,
@@ -115,112 +118,181 @@ const bitboard_t BMask[NB_SQUARE] = {
     0x0028440200000000ull, 0x0050080402000000ull, 0x0020100804020000ull, 0x0040201008040200ull
 };
 
-bitboard_t RMagicDB[0x19000], BMagicDB[0x1480];
-
-const size_t BMagicIndex[NB_SQUARE] = {
-    4992, 2624,  256,  896, 1280, 1664, 4800, 5120,
-    2560, 2656,  288,  928, 1312, 1696, 4832, 4928,
-    0,  128,  320,  960, 1344, 1728, 2304, 2432,
-    32,  160,  448, 2752, 3776, 1856, 2336, 2464,
-    64,  192,  576, 3264, 4288, 1984, 2368, 2496,
-    96,  224,  704, 1088, 1472, 2112, 2400, 2528,
-    2592, 2688,  832, 1216, 1600, 2240, 4864, 4960,
-    5056, 2720,  864, 1248, 1632, 2272, 4896, 5184
-};
-
-const size_t RMagicIndex[64] = {
-    86016, 73728, 36864, 43008, 47104, 51200, 77824, 94208,
-    69632, 32768, 38912, 10240, 14336, 53248, 57344, 81920,
-    24576, 33792,  6144, 11264, 15360, 18432, 58368, 61440,
-    26624,  4096,  7168,     0,  2048, 19456, 22528, 63488,
-    28672,  5120,  8192,  1024,  3072, 20480, 23552, 65536,
-    30720, 34816,  9216, 12288, 16384, 21504, 59392, 67584,
-    71680, 35840, 39936, 13312, 17408, 54272, 60416, 83968,
-    90112, 75776, 40960, 45056, 49152, 55296, 79872, 98304
-};
+// Number of index bits for a square: the magic shift, or the number of mask squares with PEXT
+constexpr int index_bits(bitboard_t mask, int shift)
+{
+#ifdef PEXT
+    return (void)shift, __builtin_popcountll(mask);
+#else
+    return (void)mask, 64 - shift;
+#endif
+}
 
-bitboard_t calc_sliding_attacks(Square s, bitboard_t occ, const int dir[4][2])
+constexpr size_t db_size(const bitboard_t mask[], const int shift[])
 {
-    const Rank r = rank_of(s);
-    const File f = file_of(s);
-    bitboard_t result = 0;
+    size_t size = 0;
 
-    for (int i = 0; i < 4; ++i) {
-        int dr = dir[i][0], df = dir[i][1];
-        Rank _r = r + dr;
-        File _f = f + df;
+    for (Square s = A1; s <= H8; ++s)
+        size += 1ULL << index_bits(mask[s], shift[s]);
+
+    return size;
+}
+
+// Directions are ordered so that the first 4 go down the board, and the last 4 go up
+constexpr int Dir[8][2] = {{-1,-1},{-1,0},{-1,1},{0,-1},{0,1},{1,-1},{1,0},{1,1}};
+constexpr int BDir[4] = {0, 2, 5, 7};
+constexpr int RDir[4] = {1, 3, 4, 6};
 
-        while (0 <= _r && _r < NB_RANK && 0 <= _f && _f < NB_FILE) {
-            const Square _sq = square(_r, _f);
-            bb::set(result, _sq);
+struct DirRays {
+    bitboard_t v[NB_SQUARE][8];    // excluding the origin square
+};
+
+constexpr DirRays init_dir_rays()
+{
+    DirRays rays {};
 
-            if (bb::test(occ, _sq))
-                break;
+    for (Square s = A1; s <= H8; ++s)
+        for (int d = 0; d < 8; d++) {
+            int r = s / NB_FILE + Dir[d][0], f = s % NB_FILE + Dir[d][1];
 
-            _r += dr, _f += df;
+            while (0 <= r && r < NB_RANK && 0 <= f && f < NB_FILE) {
+                rays.v[s][d] |= 1ULL << (NB_FILE * r + f);
+                r += Dir[d][0], f += Dir[d][1];
+            }
         }
-    }
 
-    return result;
+    return rays;
 }
 
-bitboard_t init_magic_occ(const Square* s, int squareCount, bitboard_t lineOcc)
+constexpr DirRays Rays = init_dir_rays();
+
+constexpr bitboard_t calc_sliding_attacks(Square s, bitboard_t occ, const int dir[4])
 {
     bitboard_t result = 0;
 
-    for (int i = 0; i < squareCount; ++i)
-        if (lineOcc & (1ULL << i))
-            bb::set(result, s[i]);
+    for (int i = 0; i < 4; ++i) {
+        const int d = dir[i];
+        const bitboard_t blockers = Rays.v[s][d] & occ;
+        result |= Rays.v[s][d];
+
+        // Remove the squares behind the first blocker
+        if (blockers) {
+            const int b = d >= 4 ? __builtin_ctzll(blockers) : 63 - __builtin_clzll(blockers);
+            result ^= Rays.v[b][d];
+        }
+    }
 
     return result;
 }
 
-void init_helper(Square s, const bitboard_t mask[], const bitboard_t magic[], const int shift[],
-                 bitboard_t magicDb[], const size_t magicIndex[], const int dir[4][2])
+// Per square tables are placed back to back, in square order
+template <size_t Size>
+struct alignas(64) MagicDB {
+    bitboard_t v[Size];
+};
+
+template <size_t Size>
+constexpr MagicDB<Size> init_magic_db(const bitboard_t mask[], const bitboard_t magic[],
+                                      const int shift[], const int dir[4])
 {
-    Square squares[NB_SQUARE];
-    int squareCount = 0;
+    MagicDB<Size> db {};
+    size_t offset = 0;
 
-    bitboard_t temp = mask[s];
+    for (Square s = A1; s <= H8; ++s) {
+        // Enumerate all subsets of mask[s] (Carry-Rippler trick). With PEXT, the n-th subset
+        // maps to index n, so idx simply counts.
+        bitboard_t occ = 0;
+        size_t idx = 0;
 
-    while (temp)
-        squares[squareCount++] = bb::pop_lsb(temp);
+        do {
+#ifdef PEXT
+            (void)magic;
+#else
+            idx = (occ * magic[s]) >> shift[s];
+#endif
+            db.v[offset + idx] = calc_sliding_attacks(s, occ, dir);
+            occ = (occ - mask[s]) & mask[s];
+            idx++;
+        } while (occ);
 
-    for (temp = 0; temp < (1ULL << squareCount); temp++) {
-        bitboard_t occ = init_magic_occ(squares, squareCount, temp);
-        const int idx = (occ * magic[s]) >> shift[s];
-        bitboard_t *p = magicDb + magicIndex[s];
-        p[idx] = calc_sliding_attacks(s, occ, dir);
+        offset += 1ULL << index_bits(mask[s], shift[s]);
     }
+
+    return db;
 }
 
-}    // namespace
+// Calculated at compile time, and shared in read-only memory by all processes
+constexpr MagicDB<db_size(BMask, BShift)> BMagicDB =
+    init_magic_db<db_size(BMask, BShift)>(BMask, BMagic, BShift, BDir);
+constexpr MagicDB<db_size(RMask, RShift)> RMagicDB =
+    init_magic_db<db_size(RMask, RShift)>(RMask, RMagic, RShift, RDir);
 
-namespace bb {
+// Everything needed for a lookup, packed so that it never spans two cache lines
+#ifdef PEXT
+struct alignas(16) Magic {
+    bitboard_t mask;
+    const bitboard_t *attacks;
+};
+#else
+struct alignas(32) Magic {
+    bitboard_t mask;
+    const bitboard_t *attacks;
+    bitboard_t magic;
+    int shift;
+};
+#endif
+
+struct Magics {
+    Magic v[NB_SQUARE];
+};
 
-void init_slider_attacks()
+constexpr Magics init_magics(const bitboard_t mask[], const bitboard_t magic[], const int shift[],
+                             const bitboard_t *db)
 {
-    const int Bdir[4][2] = {{-1,-1},{-1,1},{1,-1},{1,1}};
-    const int Rdir[4][2] = {{-1,0},{0,-1},{0,1},{1,0}};
+    Magics m {};
 
     for (Square s = A1; s <= H8; ++s) {
-        init_helper(s, BMask, BMagic, BShift, BMagicDB, BMagicIndex, Bdir);
-        init_helper(s, RMask, RMagic, RShift, RMagicDB, RMagicIndex, Rdir);
+#ifdef PEXT
+        (void)magic;
+        m.v[s] = {mask[s], db};
+#else
+        m.v[s] = {mask[s], db, magic[s], shift[s]};
+#endif
+        db += 1ULL << index_bits(mask[s], shift[s]);
     }
+
+    return m;
+}
+
+constexpr Magics BMagics = init_magics(BMask, BMagic, BShift, BMagicDB.v);
+constexpr Magics RMagics = init_magics(RMask, RMagic, RShift, RMagicDB.v);
+
+// With PEXT, the index is the occupancy of the mask squares, packed into the low bits
+size_t slider_index(bitboard_t occ, const Magic& m)
+{
+#ifdef PEXT
+    return _pext_u64(occ, m.mask);
+#else
+    return ((occ & m.mask) * m.magic) >> m.shift;
+#endif
 }
 
+}    // namespace
+
+namespace bb {
+
 bitboard_t battacks(Square s, bitboard_t occ)
 {
     BOUNDS(s, NB_SQUARE);
-    const int idx = ((occ & BMask[s]) * BMagic[s]) >> BShift[s];
-    return (BMagicDB + BMagicIndex[s])[idx];
+    const Magic& m = BMagics.v[s];
+    return m.attacks[slider_index(occ, m)];
 }
 
 bitboard_t rattacks(Square s, bitboard_t occ)
 {
     BOUNDS(s, NB_SQUARE);
-    const int idx = ((occ & RMask[s]) * RMagic[s]) >> RShift[s];
-    return (RMagicDB + RMagicIndex[s])[idx];
+    const Magic& m = RMagics.v[s];
+    return m.attacks[slider_index(occ, m)];
 }
 
 }    // namespace bb
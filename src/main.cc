@@ -14,19 +14,12 @@
  * not, see <http://www.gnu.org/licenses/>.
 */
 #include <iostream>
-#include "bitboard.h"
-#include "zobrist.h"
 #include "test.h"
-#include "pst.h"
 #include "uci.h"
 #include "tune.h"
 
 int main(int argc, char **argv)
 {
-    bb::init();
-    zobrist::init();
-    pst::init();
-
     if (argc >= 2) {
         const std::string cmd(argv[1]);
 
@@ -34,11 +27,48 @@ int main(int argc, char **argv)
             std::cout << "\nSEE: " << (test::see(true) ? "ok" : "failed") << std::endl;
         else if ((cmd == "perft" || cmd == "search") && argc >= 4) {
             const int depth = std::stoi(argv[2]), threads = std::stoi(argv[3]);
-            const uint64_t nodes = test::bench(cmd == "perft", depth, threads);
+            const std::string mode = argc >= 5 ? argv[4] : "";    // perft: "undo" or "fast"
+            const uint64_t nodes = test::bench(cmd == "perft", depth, threads,
+                                               mode == "undo" ? test::MAKE_UNDO
+                                               : mode == "fast" ? test::BULK_HASH
+                                               : test::COPY_MAKE);
             std::cout << "total = " << nodes << std::endl;
+        } else if (cmd == "suite" && argc >= 5)
+            return test::suite(argv[2], std::stoi(argv[3]), std::stoi(argv[4])) < 0 ? 1 : 0;
+        else if (cmd == "perftsuite" && argc >= 4) {
+            // Options: "fast" (bulk counting and hashing), "chess960"
+            test::PerftMode mode = test::COPY_MAKE;
+
+            for (int i = 4; i < argc; i++) {
+                if (std::string(argv[i]) == "fast")
+                    mode = test::BULK_HASH;
+                else if (std::string(argv[i]) == "chess960")
+                    Chess960 = true;
+            }
+
+            return test::perft_suite(argv[2], std::stoi(argv[3]), mode) ? 1 : 0;
+        } else if (cmd == "sliders" && argc >= 3) {
+            const uint64_t checksum = test::sliders(std::stoull(argv[2]));
+            std::cout << "checksum = " << checksum << std::endl;
+        } else if (cmd == "picker" && argc >= 3) {
+            const uint64_t checksum = test::picker(std::stoull(argv[2]));
+            std::cout << "checksum = " << checksum << std::endl;
+        } else if (cmd == "attacks" && argc >= 3) {
+            const bool ok = test::attacks(std::stoull(argv[2]));
+            std::cout << "\nattacks: " << (ok ? "ok" : "failed") << std::endl;
+        } else if (cmd == "ttstress" && argc >= 4) {
+            const bool ok = test::tt_stress(std::stoi(argv[2]), std::stoull(argv[3]));
+            std::cout << "ttstress: " << (ok ? "ok" : "failed") << std::endl;
         } else if (cmd == "logistic" && argc == 5) {
-            tune::load(argv[2]);
-            tune::search(0, std::stoi(argv[3]), std::stoi(argv[4]));
+            const int threads = std::stoi(argv[3]);
+
+            if (threads < 1) {
+                std::cout << "threads must be at least 1" << std::endl;
+                return 1;
+            }
+
+            tune::load(argv[2], threads);
+            tune::search(0, threads, std::stoi(argv[4]));
             tune::logistic();
         }
     } else
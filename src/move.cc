@@ -20,38 +20,50 @@
 bool Move::ok() const
 {
     return unsigned(from) < NB_SQUARE && unsigned(to) < NB_SQUARE
-           && ((KNIGHT <= prom && prom <= QUEEN) || prom == NB_PIECE);
+           && ((KNIGHT <= prom && prom <= QUEEN) || prom == NB_PIECE)
+           && unsigned(piece) <= NB_PIECE && unsigned(capture) <= NB_PIECE;
 }
 
 Move::operator move_t() const
 {
     assert(ok());
-    return from | (to << 6) | (prom << 12);
+    return from | (to << 6) | (prom << 12) | (type << 15) | (piece << 17) | (capture << 20);
 }
 
 Move Move::operator =(move_t em)
 {
     from = Square(em & 077);
     to = Square((em >> 6) & 077);
-    prom = Piece(em >> 12);
+    prom = Piece((em >> 12) & 7);
+    type = MoveType((em >> 15) & 3);
+    piece = Piece((em >> 17) & 7);
+    capture = Piece((em >> 20) & 7);
     assert(ok());
     return *this;
 }
 
-bool Move::is_capture(const Position& pos) const
+Move::Move(const Position& pos, move16_t em)
 {
-    const Color us = pos.turn(), them = ~us;
-    return (bb::test(pos.by_color(them), to))
-           || ((to == pos.ep_square() || relative_rank(us, to) == RANK_8)
-               && pos.piece_on(from) == PAWN);
-}
+    from = Square(em & 077);
+    to = Square((em >> 6) & 077);
+    prom = Piece(em >> 12);
+    piece = pos.piece_on(from);
+    capture = pos.piece_on(to);
+
+    // Same fields as the generator would produce
+    if (piece == KING && bb::test(pos.by_color(pos.turn()), to)) {
+        type = CASTLING;
+        capture = NB_PIECE;
+    } else if (piece == PAWN && to == pos.ep_square()) {
+        type = EN_PASSANT;
+        capture = PAWN;
+    } else
+        type = prom == NB_PIECE ? NORMAL : PROMOTION;
 
-bool Move::is_castling(const Position& pos) const
-{
-    return bb::test(pos.by_color(pos.turn()), to);
+    assert(ok());
 }
 
-std::string Move::to_string(const Position& pos) const
+std::string Move::to_string() const
 {
     assert(ok());
 
@@ -60,7 +72,7 @@ std::string Move::to_string(const Position& pos) const
     if (null())
         return "0000";
 
-    const Square _tsq = !Chess960 && is_castling(pos)
+    const Square _tsq = !Chess960 && is_castling()
                         ? (to > from ? from + 2 : from - 2)    // e1h1 -> e1g1, e1a1 -> e1c1
                         : to;
 
@@ -77,27 +89,26 @@ std::string Move::to_string(const Position& pos) const
 
 void Move::from_string(const Position& pos, const std::string& s)
 {
-    from = square(Rank(s[1] - '1'), File(s[0] - 'a'));
-    to = square(Rank(s[3] - '1'), File(s[2] - 'a'));
-    prom = s[4] ? (Piece)PieceLabel[BLACK].find(s[4]) : NB_PIECE;
-
-    if (!Chess960 && pos.piece_on(from) == KING) {
-        if (to == from + 2)      // e1g1
-            ++to;                // -> e1h1
-        else if (to == from - 2) // e1c1
-            to -= 2;             // -> e1a1
+    Square _from = square(Rank(s[1] - '1'), File(s[0] - 'a'));
+    Square _to = square(Rank(s[3] - '1'), File(s[2] - 'a'));
+    const Piece _prom = s[4] ? (Piece)PieceLabel[BLACK].find(s[4]) : NB_PIECE;
+
+    if (!Chess960 && pos.piece_on(_from) == KING) {
+        if (_to == _from + 2)      // e1g1
+            ++_to;                 // -> e1h1
+        else if (_to == _from - 2) // e1c1
+            _to -= 2;              // -> e1a1
     }
 
-    assert(ok());
+    *this = Move(pos, move16_t(_from | (_to << 6) | (_prom << 12)));
 }
 
 bool Move::pseudo_is_legal(const Position& pos) const
 {
-    const Piece p = pos.piece_on(from);
     const Square king = king_square(pos, pos.turn());
 
-    if (p == KING) {
-        if (bb::test(pos.by_color(pos.turn()), to)) {
+    if (piece == KING) {
+        if (type == CASTLING) {
             // Castling: king must not move through attacked square, and rook must not
             // be pinned
             assert(pos.piece_on(to) == ROOK);
@@ -114,7 +125,7 @@ bool Move::pseudo_is_legal(const Position& pos) const
 
         // En-passant special case: also illegal if self-check through the en-passant
         // captured pawn
-        if (to == pos.ep_square() && p == PAWN) {
+        if (type == EN_PASSANT) {
             const Color us = pos.turn(), them = ~us;
             bitboard_t occ = pieces(pos);
             bb::clear(occ, from);
@@ -136,17 +147,15 @@ int Move::see(const Position& pos) const
 
     // General case
     int gain[32] = {see_value[pos.piece_on(to)]};
-    Piece capture = pos.piece_on(from);
+    Piece victim = piece;    // next piece to be captured on the to square
     bb::clear(occ, from);
 
     // Special cases
-    if (capture == PAWN) {
-        if (to == pos.ep_square()) {
-            bb::clear(occ, to - push_inc(us));
-            gain[0] = see_value[capture];
-        } else if (relative_rank(us, to) == RANK_8)
-            gain[0] += see_value[capture = prom] - see_value[PAWN];
-    }
+    if (type == EN_PASSANT) {
+        bb::clear(occ, to - push_inc(us));
+        gain[0] = see_value[PAWN];
+    } else if (type == PROMOTION)
+        gain[0] += see_value[victim = prom] - see_value[PAWN];
 
     // Easy case: to is not defended
     // TODO: explore performance tradeoff between using pos.attacked() and using attackers below
@@ -186,13 +195,13 @@ int Move::see(const Position& pos) const
         // Add the new entry to the gain[] array
         idx++;
         assert(idx < 32);
-        gain[idx] = see_value[capture] - gain[idx-1];
+        gain[idx] = see_value[victim] - gain[idx-1];
 
         if (p == PAWN && relative_rank(us, to) == RANK_8) {
             gain[idx] += see_value[QUEEN] - see_value[PAWN];
-            capture = QUEEN;
+            victim = QUEEN;
         } else
-            capture = p;
+            victim = p;
     }
 
     do {
@@ -4,26 +4,38 @@
 
 class Position;
 
-typedef uint16_t move_t;    // from:6, to:6, prom: 3 (NB_PIECE if none)
+// from:6, to:6, prom:3 (NB_PIECE if none), type:2, piece:3, capture:3 (NB_PIECE if none). The
+// generators fill in every field, so that consumers need not look at the board.
+typedef uint32_t move_t;
+
+// from:6, to:6, prom:3. Compact form for the TT and the PV. Use Move(pos, em) to expand it.
+typedef uint16_t move16_t;
+
+inline move16_t compact(move_t em) { return em & 077777; }
+
+enum MoveType {NORMAL, PROMOTION, EN_PASSANT, CASTLING};
 
 struct Move {
     Square from, to;
     Piece prom;
+    MoveType type;
+    Piece piece, capture;    // moving and captured piece (a castling move captures nothing)
 
     bool ok() const;
 
     Move() = default;
     Move(move_t em) { *this = em; }
+    Move(const Position& pos, move16_t em);
     Move(const Position& pos, const std::string& s) { from_string(pos, s); }
 
     operator move_t() const;
     Move operator =(move_t em);
 
     bool null() const { return (from | to | prom) == 0; }
-    bool is_capture(const Position& pos) const;
-    bool is_castling(const Position& pos) const;
+    bool is_capture() const { return capture != NB_PIECE || type == PROMOTION; }    // or promotion
+    bool is_castling() const { return type == CASTLING; }
 
-    std::string to_string(const Position& pos) const;
+    std::string to_string() const;
     void from_string(const Position& pos, const std::string& s);
 
     bool pseudo_is_legal(const Position& pos) const;
@@ -16,11 +16,70 @@
 #include <iostream>
 #include <sstream>
 #include <cstring>    // std::memset
+#include <algorithm>    // std::min
 #include "bitboard.h"
 #include "position.h"
 #include "pst.h"
 #include "zobrist.h"
 
+#ifdef ATTACK_COUNTS
+
+namespace {
+
+// Add or remove one attacker on each square of b, in bit-sliced counts
+void add_counts(bitboard_t count[5], bitboard_t b)
+{
+    for (int i = 0; i < 5; i++) {
+        const bitboard_t carry = count[i] & b;
+        count[i] ^= b;
+        b = carry;
+    }
+
+    assert(!b);
+}
+
+void sub_counts(bitboard_t count[5], bitboard_t b)
+{
+    for (int i = 0; i < 5; i++) {
+        const bitboard_t borrow = ~count[i] & b;
+        count[i] ^= b;
+        b = borrow;
+    }
+
+    assert(!b);
+}
+
+}    // namespace
+
+// Called while s is empty, to add (or remove) piece p on s: its own attacks, and the sliders whose
+// rays through s it blocks (or unblocks).
+void Position::update_attacks(Color c, Piece p, Square s, bool add)
+{
+    const bitboard_t occ = pieces(*this);
+    assert(!bb::test(occ, s));
+
+    const bitboard_t blocked = occ | (1ULL << s);
+    bitboard_t b = bb::rattacks(s, occ) & pieces(*this, ROOK, QUEEN);
+
+    while (b) {
+        const Square x = bb::pop_lsb(b);
+        const bitboard_t beyond = bb::rattacks(x, occ) & ~bb::rattacks(x, blocked);
+        (add ? sub_counts : add_counts)(_attackCount[color_on(*this, x)], beyond);
+    }
+
+    b = bb::battacks(s, occ) & pieces(*this, BISHOP, QUEEN);
+
+    while (b) {
+        const Square x = bb::pop_lsb(b);
+        const bitboard_t beyond = bb::battacks(x, occ) & ~bb::battacks(x, blocked);
+        (add ? sub_counts : add_counts)(_attackCount[color_on(*this, x)], beyond);
+    }
+
+    (add ? add_counts : sub_counts)(_attackCount[c], piece_attacks(c, p, s, occ));
+}
+
+#endif
+
 void Position::clear()
 {
     std::memset(this, 0, sizeof(*this));
@@ -29,6 +88,7 @@ void Position::clear()
         _pieceOn[s] = NB_PIECE;
 }
 
+template <bool Update>
 void Position::clear(Color c, Piece p, Square s)
 {
     BOUNDS(c, NB_COLOR);
@@ -39,7 +99,15 @@ void Position::clear(Color c, Piece p, Square s)
     bb::clear(_byPiece[p], s);
 
     _pieceOn[s] = NB_PIECE;
-    _pst -= pst::table[c][p][s];
+
+    if (!Update)
+        return;
+
+#ifdef ATTACK_COUNTS
+    update_attacks(c, p, s, false);
+#endif
+
+    _pst -= pst::table(c, p, s);
     _key ^= zobrist::key(c, p, s);
 
     if (p <= QUEEN)
@@ -48,17 +116,27 @@ void Position::clear(Color c, Piece p, Square s)
         _pawnKey ^= zobrist::key(c, p, s);
 }
 
+template <bool Update>
 void Position::set(Color c, Piece p, Square s)
 {
     BOUNDS(c, NB_COLOR);
     BOUNDS(p, NB_PIECE);
     BOUNDS(s, NB_SQUARE);
 
+#ifdef ATTACK_COUNTS
+    if (Update)
+        update_attacks(c, p, s, true);
+#endif
+
     bb::set(_byColor[c], s);
     bb::set(_byPiece[p], s);
 
     _pieceOn[s] = p;
-    _pst += pst::table[c][p][s];
+
+    if (!Update)
+        return;
+
+    _pst += pst::table(c, p, s);
     _key ^= zobrist::key(c, p, s);
 
     if (p <= QUEEN)
@@ -70,34 +148,46 @@ void Position::set(Color c, Piece p, Square s)
 void Position::finish()
 {
     const Color us = turn(), them = ~us;
-    const Square ksq = king_square(*this, us);
 
-    _attacked = attacked_by(*this, them);
-    _checkers = bb::test(_attacked, ksq) ? attackers_to(*this, ksq, pieces(*this)) & by_color(them) : 0;
-    _pins = calc_pins(*this);
+    _checkers = attackers_to(*this, king_square(*this, us), pieces(*this)) & by_color(them);
+
+    // Invalid values, so that attacked() and pins() compute them on first use. An attack map
+    // always contains the king's neighbours, and pins never contain all squares.
+    _attacked = 0;
+    _pins = ~0ULL;
 }
 
-void Position::set(const std::string& fen)
+const char *Position::set(const char *fen, const char *end)
 {
     clear();
-    std::istringstream is(fen);
-    std::string token;
+    const char *p = fen;
+
+    const auto next_field = [&]() {
+        while (p != end && *p == ' ')
+            p++;
+    };
+
+    const auto field_end = [&](char c) {
+        return c == ' ' || c == ',' || c == ';' || c == '\n' || c == '\r';
+    };
 
     // Piece placement
-    is >> token;
+    next_field();
     Square s = A8;
 
-    for (char c : token) {
+    for (; p != end && !field_end(*p); p++) {
+        const char c = *p;
+
         if (isdigit(c))
             s += c - '0';
         else if (c == '/')
             s += 2 * DOWN;
         else {
             for (Color col = WHITE; col <= BLACK; ++col) {
-                const Piece p = Piece(PieceLabel[col].find(c));
+                const Piece pc = Piece(PieceLabel[col].find(c));
 
-                if (unsigned(p) < NB_PIECE) {
-                    set(col, p, s);
+                if (unsigned(pc) < NB_PIECE) {
+                    set(col, pc, s);
                     ++s;
                 }
             }
@@ -105,43 +195,82 @@ void Position::set(const std::string& fen)
     }
 
     // Turn of play
-    is >> token;
+    next_field();
 
-    if (token == "w")
-        _turn = WHITE;
-    else {
+    if (p != end && *p == 'b') {
         _turn = BLACK;
         _key ^= zobrist::turn();
-    }
+    } else
+        _turn = WHITE;
+
+    for (; p != end && !field_end(*p); p++);
 
     // Castling rights
-    is >> token;
+    next_field();
 
-    if (token != "-") {
-        for (char c : token) {
-            const Rank r = isupper(c) ? RANK_1 : RANK_8;
-            c = toupper(c);
+    for (; p != end && !field_end(*p); p++) {
+        const Rank r = isupper(*p) ? RANK_1 : RANK_8;
+        const char c = toupper(*p);
 
-            if (c == 'K')
-                s = square(r, FILE_H);
-            else if (c == 'Q')
-                s = square(r, FILE_A);
-            else if ('A' <= c && c <= 'H')
-                s = square(r, File(c - 'A'));
+        if (Chess960 && (c == 'K' || c == 'Q')) {
+            // X-FEN: the outermost rook on that side
+            const bitboard_t rooks = pieces(*this, isupper(*p) ? WHITE : BLACK, ROOK) & bb::rank(r);
 
-            bb::set(_castlableRooks, s);
-        }
+            if (!rooks)
+                continue;
 
-        _key ^= zobrist::castling(castlable_rooks());
+            s = c == 'K' ? bb::msb(rooks) : bb::lsb(rooks);
+        } else if (c == 'K')
+            s = square(r, FILE_H);
+        else if (c == 'Q')
+            s = square(r, FILE_A);
+        else if ('A' <= c && c <= 'H')
+            s = square(r, File(c - 'A'));
+        else
+            continue;    // '-'
+
+        bb::set(_castlableRooks, s);
     }
 
-    // En passant and 50 move
-    is >> token;
-    _epSquare = string_to_square(token);
+    _key ^= zobrist::castling(castlable_rooks());
+
+    // En passant
+    next_field();
+    _epSquare = NB_SQUARE;
+
+    if (end - p >= 2 && 'a' <= p[0] && p[0] <= 'h' && '1' <= p[1] && p[1] <= '8')
+        _epSquare = square(Rank(p[1] - '1'), File(p[0] - 'a'));
+
     _key ^= zobrist::en_passant(ep_square());
-    is >> _rule50;
+
+    for (; p != end && !field_end(*p); p++);
+
+    // 50 move counter and move number. Both are optional (eg. EPD).
+    const char *q = p;
+    next_field();
+
+    if (p != end && isdigit(*p)) {
+        int rule50 = 0;
+
+        // Saturate while reading digits, so that a long number cannot overflow
+        for (; p != end && isdigit(*p); p++)
+            rule50 = std::min(10 * rule50 + *p - '0', 100);
+
+        _rule50 = rule50;
+        q = p;
+        next_field();
+
+        for (; p != end && isdigit(*p); p++)
+            q = p + 1;
+    }
 
     finish();
+    return q;
+}
+
+void Position::set(const std::string& fen)
+{
+    set(fen.data(), fen.data() + fen.size());
 }
 
 bitboard_t Position::by_color(Color c) const
@@ -160,14 +289,14 @@ bitboard_t Position::by_piece(Piece p) const
 
 Color Position::turn() const
 {
-    return _turn;
+    return Color(_turn);
 }
 
 Square Position::ep_square() const
 {
     BOUNDS(_epSquare, NB_SQUARE+1);
 
-    return _epSquare;
+    return Square(_epSquare);
 }
 
 int Position::rule50() const
@@ -187,6 +316,25 @@ bitboard_t Position::checkers() const
 
 bitboard_t Position::attacked() const
 {
+#ifdef ATTACK_COUNTS
+    if (!_attacked) {
+        const bitboard_t *count = _attackCount[~turn()];
+        _attacked = count[0] | count[1] | count[2] | count[3] | count[4];
+
+        // attacked_by() sees through our king, so that it cannot step back along a checking ray
+        bitboard_t b = checkers() & ~pieces(*this, KNIGHT, PAWN);
+        const bitboard_t occ = pieces(*this) ^ pieces(*this, turn(), KING);
+
+        while (b) {
+            const Square s = bb::pop_lsb(b);
+            _attacked |= piece_attacks(~turn(), piece_on(s), s, occ);
+        }
+    }
+#endif
+
+    if (!_attacked)
+        _attacked = attacked_by(*this, ~turn());
+
     assert(_attacked == attacked_by(*this, ~turn()));
 
     return _attacked;
@@ -194,6 +342,9 @@ bitboard_t Position::attacked() const
 
 bitboard_t Position::pins() const
 {
+    if (_pins == ~0ULL)
+        _pins = calc_pins(*this);
+
     assert(_pins == calc_pins(*this));
 
     return _pins;
@@ -240,74 +391,133 @@ Piece Position::piece_on(Square s) const
     return Piece(_pieceOn[s]);
 }
 
-void Position::set(const Position& before, Move m)
+void Position::play(Move m)
 {
-    *this = before;
-    _rule50++;
-
+    assert(m.piece == piece_on(m.from));
     const Color us = turn(), them = ~us;
-    const Piece p = piece_on(m.from);
-    const Piece capture = piece_on(m.to);
+    const Square epSquare = ep_square();
+    const bitboard_t castlableRooks = castlable_rooks();
+
+    _rule50++;
 
-    // Capture piece on to square (if any)
-    if (capture != NB_PIECE) {
+    // Capture piece (if any)
+    if (m.capture != NB_PIECE) {
         _rule50 = 0;
-        // Use color_on() instead of them, because we could be playing a KxR castling here
-        clear(color_on(*this, m.to), capture, m.to);
 
-        // Capturing a rook alters corresponding castling right
-        if (capture == ROOK)
-            _castlableRooks &= ~(1ULL << m.to);
+        if (m.type == EN_PASSANT)
+            clear(them, PAWN, m.to - push_inc(us));
+        else {
+            clear(them, m.capture, m.to);
+
+            // Capturing a rook alters corresponding castling right
+            if (m.capture == ROOK)
+                _castlableRooks &= ~(1ULL << m.to);
+        }
     }
 
-    // Move our piece
-    clear(us, p, m.from);
-    set(us, p, m.to);
+    // Move our piece (or pieces, for castling, encoded KxR)
+    if (m.type == CASTLING) {
+        const Rank r = rank_of(m.from);
+
+        clear(us, KING, m.from);
+        clear(us, ROOK, m.to);
+        set(us, KING, square(r, m.to > m.from ? FILE_G : FILE_C));
+        set(us, ROOK, square(r, m.to > m.from ? FILE_F : FILE_D));
+    } else {
+        clear(us, m.piece, m.from);
+        set(us, m.type == PROMOTION ? m.prom : m.piece, m.to);
+    }
 
-    if (p == PAWN) {
+    if (m.piece == PAWN) {
         // reset rule50, and set epSquare
         const int push = push_inc(us);
         _rule50 = 0;
         _epSquare = m.to == m.from + 2 * push ? m.from + push : NB_SQUARE;
-
-        // handle ep-capture and promotion
-        if (m.to == before.ep_square())
-            clear(them, p, m.to - push);
-        else if (rank_of(m.to) == RANK_8 || rank_of(m.to) == RANK_1) {
-            clear(us, p, m.to);
-            set(us, m.prom, m.to);
-        }
     } else {
         _epSquare = NB_SQUARE;
 
-        if (p == ROOK)
+        if (m.piece == ROOK)
             // remove corresponding castling right
             _castlableRooks &= ~(1ULL << m.from);
-        else if (p == KING) {
+        else if (m.piece == KING)
             // Lose all castling rights
             _castlableRooks &= ~bb::rank(Rank(us * RANK_8));
-
-            // Castling
-            if (bb::test(before.by_color(us), m.to)) {
-                // Capturing our own piece can only be a castling move, encoded KxR
-                assert(before.piece_on(m.to) == ROOK);
-                const Rank r = rank_of(m.from);
-
-                clear(us, KING, m.to);
-                set(us, KING, square(r, m.to > m.from ? FILE_G : FILE_C));
-                set(us, ROOK, square(r, m.to > m.from ? FILE_F : FILE_D));
-            }
-        }
     }
 
     _turn = them;
     _key ^= zobrist::turn();
-    _key ^= zobrist::en_passant(before.ep_square()) ^ zobrist::en_passant(ep_square());
-    _key ^= zobrist::castling(before.castlable_rooks() ^ castlable_rooks());
+    _key ^= zobrist::en_passant(epSquare) ^ zobrist::en_passant(ep_square());
+    _key ^= zobrist::castling(castlableRooks ^ castlable_rooks());
 
     finish();
 }
 
+void Position::set(const Position& before, Move m)
+{
+    *this = before;
+    play(m);
+}
+
+void Position::do_move(Move m, Undo& u)
+{
+    u.castlableRooks = _castlableRooks;
+    u.checkers = _checkers;
+    u.attacked = _attacked;
+    u.pins = _pins;
+    u.key = _key;
+    u.pawnKey = _pawnKey;
+    u.pst = _pst;
+    u.pieceMaterial[WHITE] = _pieceMaterial[WHITE];
+    u.pieceMaterial[BLACK] = _pieceMaterial[BLACK];
+    u.epSquare = Square(_epSquare);
+    u.rule50 = _rule50;
+#ifdef ATTACK_COUNTS
+    std::memcpy(u.attackCount, _attackCount, sizeof(_attackCount));
+#endif
+
+    play(m);
+}
+
+void Position::undo_move(Move m, const Undo& u)
+{
+    const Color them = turn(), us = ~them;
+
+    // Put pieces back on the board. Everything else is restored from u, so the incremental
+    // updates done by clear() and set() are not needed.
+    if (m.type == CASTLING) {
+        const Rank r = rank_of(m.from);
+
+        clear<false>(us, KING, square(r, m.to > m.from ? FILE_G : FILE_C));
+        clear<false>(us, ROOK, square(r, m.to > m.from ? FILE_F : FILE_D));
+        set<false>(us, KING, m.from);
+        set<false>(us, ROOK, m.to);
+    } else {
+        clear<false>(us, m.type == PROMOTION ? m.prom : m.piece, m.to);
+        set<false>(us, m.piece, m.from);
+
+        if (m.type == EN_PASSANT)
+            set<false>(them, PAWN, m.to - push_inc(us));
+        else if (m.capture != NB_PIECE)
+            set<false>(them, m.capture, m.to);
+    }
+
+    _castlableRooks = u.castlableRooks;
+    _checkers = u.checkers;
+    _attacked = u.attacked;
+    _pins = u.pins;
+    _key = u.key;
+    _pawnKey = u.pawnKey;
+    _pst = u.pst;
+    _pieceMaterial[WHITE] = u.pieceMaterial[WHITE];
+    _pieceMaterial[BLACK] = u.pieceMaterial[BLACK];
+    _turn = us;
+    _epSquare = u.epSquare;
+    _rule50 = u.rule50;
+#ifdef ATTACK_COUNTS
+    std::memcpy(_attackCount, u.attackCount, sizeof(_attackCount));
+#endif
+}
+
 void Position::toggle(const Position& before)
 {
     *this = before;
@@ -320,6 +530,18 @@ void Position::toggle(const Position& before)
     finish();
 }
 
+bitboard_t piece_attacks(Color c, Piece p, Square s, bitboard_t occ)
+{
+    BOUNDS(p, NB_PIECE);
+
+    return p == KNIGHT ? bb::nattacks(s)
+           : p == BISHOP ? bb::battacks(s, occ)
+           : p == ROOK ? bb::rattacks(s, occ)
+           : p == QUEEN ? bb::battacks(s, occ) | bb::rattacks(s, occ)
+           : p == KING ? bb::kattacks(s)
+           : bb::pattacks(c, s);
+}
+
 bitboard_t attacked_by(const Position& pos, Color c)
 {
     BOUNDS(c, NB_COLOR);
@@ -398,6 +620,60 @@ uint64_t calc_pawn_key(const Position& pos)
     return key;
 }
 
+uint64_t key_after(const Position& pos, Move m)
+{
+    const Color us = pos.turn(), them = ~us;
+    const bitboard_t castlableRooks = pos.castlable_rooks();
+    uint64_t key = pos.key() ^ zobrist::turn() ^ zobrist::en_passant(pos.ep_square());
+    Square epSquare = NB_SQUARE;
+
+    // A castlable rook can only be on from (rook move) or to (rook capture, or castling)
+    bitboard_t nextCastlableRooks = castlableRooks & ~((1ULL << m.from) | (1ULL << m.to));
+
+    if (m.piece == KING)
+        nextCastlableRooks &= ~bb::rank(Rank(us * RANK_8));
+
+    if (m.type == CASTLING) {
+        // Castling, encoded KxR
+        const Rank r = rank_of(m.from);
+        key ^= zobrist::key(us, KING, m.from) ^ zobrist::key(us, ROOK, m.to)
+               ^ zobrist::key(us, KING, square(r, m.to > m.from ? FILE_G : FILE_C))
+               ^ zobrist::key(us, ROOK, square(r, m.to > m.from ? FILE_F : FILE_D));
+    } else {
+        key ^= zobrist::key(us, m.piece, m.from)
+               ^ zobrist::key(us, m.type == PROMOTION ? m.prom : m.piece, m.to);
+
+        if (m.type == EN_PASSANT)
+            key ^= zobrist::key(them, PAWN, m.to - push_inc(us));
+        else if (m.capture != NB_PIECE)
+            key ^= zobrist::key(them, m.capture, m.to);
+
+        if (m.piece == PAWN && m.to == m.from + 2 * push_inc(us))
+            epSquare = m.from + push_inc(us);
+    }
+
+    return key ^ zobrist::en_passant(epSquare)
+           ^ zobrist::castling(castlableRooks ^ nextCastlableRooks);
+}
+
+uint64_t pawn_key_after(const Position& pos, Move m)
+{
+    assert(m.piece == PAWN);
+
+    const Color us = pos.turn(), them = ~us;
+    uint64_t key = pos.pawn_key() ^ zobrist::key(us, PAWN, m.from);
+
+    if (m.type != PROMOTION)
+        key ^= zobrist::key(us, PAWN, m.to);
+
+    if (m.type == EN_PASSANT)
+        key ^= zobrist::key(them, PAWN, m.to - push_inc(us));
+    else if (m.capture == PAWN)
+        key ^= zobrist::key(them, PAWN, m.to);
+
+    return key;
+}
+
 eval_t calc_pst(const Position& pos)
 {
     eval_t result {0, 0};
@@ -407,7 +683,7 @@ eval_t calc_pst(const Position& pos)
             bitboard_t b = pieces(pos, c, p);
 
             while (b)
-                result += pst::table[c][p][bb::pop_lsb(b)];
+                result += pst::table(c, p, bb::pop_lsb(b));
         }
 
     return result;
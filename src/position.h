@@ -2,29 +2,59 @@
 #include "types.h"
 #include "move.h"
 
-class Position {
+// State saved by Position::do_move(), that undo_move() cannot recover from the board alone
+struct Undo {
+    bitboard_t castlableRooks, checkers, attacked, pins;
+    uint64_t key, pawnKey;
+    eval_t pst, pieceMaterial[NB_COLOR];
+    Square epSquare;
+    int rule50;
+#ifdef ATTACK_COUNTS
+    bitboard_t attackCount[NB_COLOR][5];
+#endif
+};
+
+// Laid out in cache lines, hottest first: bitboards, then keys, checkers and game state, then
+// the mailbox, then the fields computed on demand.
+class alignas(64) Position {
     bitboard_t _byColor[NB_COLOR];
     bitboard_t _byPiece[NB_PIECE];
-    bitboard_t _castlableRooks;
-    bitboard_t _attacked, _checkers, _pins;
+
     uint64_t _key, _pawnKey;
+    bitboard_t _checkers, _castlableRooks;
     eval_t _pst;
-    char _pieceOn[NB_SQUARE];
-    Color _turn;
-    Square _epSquare;
-    int _rule50;
     eval_t _pieceMaterial[NB_COLOR];
+    uint8_t _turn, _epSquare, _rule50;
+
+    alignas(64) char _pieceOn[NB_SQUARE];
+
+    mutable bitboard_t _attacked, _pins;    // computed on demand
+
+#ifdef ATTACK_COUNTS
+    // Number of attackers of each square, by color, updated incrementally. Bit-sliced: bit i of
+    // the count for square s is in _attackCount[c][i]. A square has at most 16 attackers.
+    bitboard_t _attackCount[NB_COLOR][5];
+    void update_attacks(Color c, Piece p, Square s, bool add);
+#endif
 
     void clear();
-    void clear(Color c, Piece p, Square s);
-    void set(Color c, Piece p, Square s);
+    template <bool Update=true> void clear(Color c, Piece p, Square s);
+    template <bool Update=true> void set(Color c, Piece p, Square s);
     void finish();
+    void play(Move m);
 
 public:
+    // Parse a FEN from [fen, end), which may continue with anything else (EPD operations, a
+    // score, etc.). Returns a pointer past the last field read.
+    const char *set(const char *fen, const char *end);
     void set(const std::string& fen);
     void set(const Position& before, Move m);
     void toggle(const Position& before);
 
+    // Make/unmake, as an alternative to copy-make with set(before, m)
+    void do_move(Move m, Undo& u);
+    void undo_move(Move m, const Undo& u);
+
     bitboard_t by_color(Color c) const;
     bitboard_t by_piece(Piece p) const;
     Color turn() const;
@@ -41,7 +71,16 @@ public:
     Piece piece_on(Square s) const;
 };
 
+#ifdef ATTACK_COUNTS
+static_assert(alignof(Position) == 64 && sizeof(Position) == 5 * 64,
+              "Position must occupy exactly 5 cache lines");
+#else
+static_assert(alignof(Position) == 64 && sizeof(Position) == 4 * 64,
+              "Position must occupy exactly 4 cache lines");
+#endif
+
 bitboard_t attacked_by(const Position& pos, Color c);
+bitboard_t piece_attacks(Color c, Piece p, Square s, bitboard_t occ);
 bitboard_t calc_pins(const Position& pos);
 
 uint64_t calc_key(const Position& pos);
@@ -49,6 +88,10 @@ uint64_t calc_pawn_key(const Position& pos);
 eval_t calc_pst(const Position& pos);
 eval_t calc_piece_material(const Position& pos, Color c);
 
+// Keys of the position after m, without playing it (pawn_key_after() is for pawn moves only)
+uint64_t key_after(const Position& pos, Move m);
+uint64_t pawn_key_after(const Position& pos, Move m);
+
 bitboard_t pieces(const Position& pos);
 bitboard_t pieces(const Position& pos, Piece p1, Piece p2);
 bitboard_t pieces(const Position& pos, Color c, Piece p);
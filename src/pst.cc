@@ -16,52 +16,50 @@
 #include <algorithm>
 #include "pst.h"
 
-namespace pst {
-
-eval_t table[NB_COLOR][NB_PIECE][NB_SQUARE];
+namespace {
 
-const int Center[NB_FILE] = {-5,-2, 0, 2, 2, 0,-2,-5};
+constexpr int Center[NB_FILE] = {-5,-2, 0, 2, 2, 0,-2,-5};
 
-eval_t knight(Rank r, File f)
+constexpr eval_t knight(Rank r, File f)
 {
-    const eval_t CenterWeight = {10, 3};
+    constexpr eval_t CenterWeight = {10, 3};
     return CenterWeight * (Center[r] + Center[f]);
 }
 
-eval_t bishop(Rank r, File f)
+constexpr eval_t bishop(Rank r, File f)
 {
-    const eval_t CenterWeight = {2, 3};
-    const eval_t DiagonalWeight = {8, 0};
-    const eval_t BackRankWeight = {-20, 0};
+    constexpr eval_t CenterWeight = {2, 3};
+    constexpr eval_t DiagonalWeight = {8, 0};
+    constexpr eval_t BackRankWeight = {-20, 0};
 
     return CenterWeight * (Center[r] + Center[f])
            + DiagonalWeight * (r + f == 7 || r - f == 0)
            + BackRankWeight * (r == RANK_1);
 }
 
-eval_t rook(Rank r, File f)
+constexpr eval_t rook(Rank r, File f)
 {
-    const eval_t FileWeight = {3, 0};
-    const eval_t SeventhWeight = {16, 16};
+    constexpr eval_t FileWeight = {3, 0};
+    constexpr eval_t SeventhWeight = {16, 16};
 
     return FileWeight * Center[f]
            + SeventhWeight * (r == RANK_7);
 }
 
-eval_t queen(Rank r, File f)
+constexpr eval_t queen(Rank r, File f)
 {
-    const eval_t CenterWeight = {0, 4};
-    const eval_t BackRankWeight = {-10, 0};
+    constexpr eval_t CenterWeight = {0, 4};
+    constexpr eval_t BackRankWeight = {-10, 0};
 
     return CenterWeight * (Center[r] + Center[f])
            + BackRankWeight * (r == RANK_1);
 }
 
-eval_t king(Rank r, File f)
+constexpr eval_t king(Rank r, File f)
 {
-    static const int FileWeight[NB_FILE] = {54, 84, 40, 0, 0, 40, 84, 54};
-    static const int RankWeight[NB_RANK] = {28, 0,-28,-46,-58,-70,-70,-70};
-    static const int CenterWeight = 14;
+    constexpr int FileWeight[NB_FILE] = {54, 84, 40, 0, 0, 40, 84, 54};
+    constexpr int RankWeight[NB_RANK] = {28, 0,-28,-46,-58,-70,-70,-70};
+    constexpr int CenterWeight = 14;
 
     return eval_t {
         FileWeight[f] + RankWeight[r],
@@ -69,9 +67,9 @@ eval_t king(Rank r, File f)
     };
 }
 
-eval_t pawn(Rank r, File f)
+constexpr eval_t pawn(Rank r, File f)
 {
-    const eval_t PCenter = {36, 0};
+    constexpr eval_t PCenter = {36, 0};
     eval_t e = {0, 0};
 
     if (f == FILE_D || f == FILE_E) {
@@ -84,19 +82,41 @@ eval_t pawn(Rank r, File f)
     return e;
 }
 
-void init()
+struct Table {
+    eval_t v[NB_COLOR][NB_PIECE][NB_SQUARE];
+};
+
+constexpr Table init()
 {
     typedef eval_t (*pst_fn)(Rank, File);
-    const pst_fn PstFn[NB_PIECE] = {&knight, &bishop, &rook, &queen, &king, &pawn};
+    constexpr pst_fn PstFn[NB_PIECE] = {&knight, &bishop, &rook, &queen, &king, &pawn};
+    Table t {};
 
     // Calculate PST, based on specialized functions for each piece
     for (Color c = WHITE; c <= BLACK; ++c)
         for (Piece p = KNIGHT; p < NB_PIECE; ++p)
             for (Square s = A1; s <= H8; ++s) {
-                const Rank rr = Rank(rank_of(s) ^ (RANK_8 * c));
-                const File f = file_of(s);
-                table[c][p][s] = (Material[p] + (*PstFn[p])(rr, f)) * (c == WHITE ? 1 : -1);
+                const Rank rr = Rank((s / NB_FILE) ^ (RANK_8 * c));
+                const File f = File(s % NB_FILE);
+                t.v[c][p][s] = (Material[p] + (*PstFn[p])(rr, f)) * (c == WHITE ? 1 : -1);
             }
+
+    return t;
+}
+
+constexpr Table T = init();
+
+}    // namespace
+
+namespace pst {
+
+eval_t table(Color c, Piece p, Square s)
+{
+    BOUNDS(c, NB_COLOR);
+    BOUNDS(p, NB_PIECE);
+    BOUNDS(s, NB_SQUARE);
+
+    return T.v[c][p][s];
 }
 
 }    // namespace pst
@@ -3,8 +3,6 @@
 
 namespace pst {
 
-extern eval_t table[NB_COLOR][NB_PIECE][NB_SQUARE];
-
-void init();
+eval_t table(Color c, Piece p, Square s);
 
 }    // namespace pst
@@ -66,8 +66,8 @@ int draw_score(int ply)
     return (ply & 1 ? Contempt : -Contempt) * EP / 100;
 }
 
-template<bool Qsearch = false>
-int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::vector<move_t>& pv)
+template<bool Qsearch>
+int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::vector<move16_t>& pv)
 {
     assert(gameStack[ThreadId].back() == pos.key());
     assert(alpha < beta);
@@ -91,7 +91,7 @@ int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::v
         }
     }
 
-    std::vector<move_t> childPv;
+    std::vector<move16_t> childPv;
 
     if (pvNode) {
         childPv.reserve(MAX_PLY - ply);
@@ -176,23 +176,29 @@ int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::v
     // Move loop
     while (!S.done() && alpha < beta) {
         int see;
-        currentMove = S.select(pos, see);
-
-        if (!currentMove.pseudo_is_legal(pos))
-            continue;
-
+        currentMove = S.select(see);
         moveCount++;
 
         // Prune losing captures in the qsearch
         if (Qsearch && see < 0 && !pos.checkers())
             continue;
 
-        // SEE proxy tells us we're unlikely to beat alpha
-        if (Qsearch && !pos.checkers() && staticEval + P/2 <= alpha && see <= 0)
+        // SEE proxy tells us we're unlikely to beat alpha (does not apply to quiet checks)
+        if (Qsearch && !pos.checkers() && staticEval + P/2 <= alpha && see <= 0
+                && currentMove.is_capture())
             continue;
 
+        // Prefetch the child's TT entry, and pawn hash entry for pawn moves, so that the cache
+        // misses overlap with playing the move
+        const uint64_t nextKey = key_after(pos, currentMove);
+        tt::prefetch(nextKey);
+
+        if (currentMove.piece == PAWN)
+            __builtin_prefetch(&PawnHash[pawn_key_after(pos, currentMove) & (NB_PAWN_ENTRY - 1)]);
+
         // Play move
         nextPos.set(pos, currentMove);
+        assert(nextPos.key() == nextKey);
 
         // Prune losing captures in the search, near the leaves
         if (!Qsearch && depth <= 4 && see < 0
@@ -201,7 +207,9 @@ int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::v
 
         gameStack[ThreadId].push(nextPos.key());
 
-        const int ext = see >= 0 && nextPos.checkers();
+        // Check extension. Not for quiet checks in the qsearch, so they cannot recur.
+        const int ext = see >= 0 && nextPos.checkers()
+                        && !(Qsearch && !pos.checkers() && !currentMove.is_capture());
         const int nextDepth = depth - 1 + ext;
 
         // Recursion
@@ -219,9 +227,9 @@ int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::v
             if (moveCount == 1)
                 score = -recurse(nextPos, ply+1, nextDepth, -beta, -alpha, childPv);
             else {
-                int reduction = see < 0 || (!currentMove.is_capture(pos) && !nextPos.checkers());
+                int reduction = see < 0 || (!currentMove.is_capture() && !nextPos.checkers());
 
-                if (!currentMove.is_capture(pos) && !pos.checkers() && !nextPos.checkers())
+                if (!currentMove.is_capture() && !pos.checkers() && !nextPos.checkers())
                     reduction++;
 
                 // Reduced depth, zero window
@@ -252,7 +260,7 @@ int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::v
                 bestMove = currentMove;
 
                 if (pvNode) {
-                    pv[0] = currentMove;
+                    pv[0] = compact(currentMove);
 
                     for (int i = 0; i < MAX_PLY - ply; i++)
                         if (!(pv[i + 1] = childPv[i]))
@@ -270,9 +278,9 @@ int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::v
         return pos.checkers() ? mated_in(ply) : draw_score(ply);
 
     // Update History
-    if (!Qsearch && alpha > oldAlpha && !bestMove.is_capture(pos))
+    if (!Qsearch && alpha > oldAlpha && !bestMove.is_capture())
         for (size_t i = 0; i < S.idx; i++) {
-            Move m(S.moves[i]);
+            Move m(S.list.moves[i]);
             const int bonus = depth * depth;
             H.update(m, m == bestMove ? bonus : -bonus);
         }
@@ -283,13 +291,13 @@ int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::v
     tte.score = tt::score_to_tt(bestScore, ply);
     tte.eval = pos.checkers() ? -INF : staticEval;
     tte.depth = depth;
-    tte.move = bestMove;
+    tte.move = compact(bestMove);
     tt::write(tte);
 
     return bestScore;
 }
 
-int aspirate(const Position& pos, int depth, std::vector<move_t>& pv, int score)
+int aspirate(const Position& pos, int depth, std::vector<move16_t>& pv, int score)
 {
     if (depth <= 1) {
         assert(depth == 1);
@@ -314,11 +322,11 @@ int aspirate(const Position& pos, int depth, std::vector<move_t>& pv, int score)
     }
 }
 
-void iterate(const Position& pos, const Limits& lim, const zobrist::GameStack& initialGameStack,
+void iterate(Position pos, const Limits& lim, const zobrist::GameStack& initialGameStack,
              std::vector<int>& iteration, int threadId)
 {
     ThreadId = threadId;
-    std::vector<move_t> pv(MAX_PLY + 1);
+    std::vector<move16_t> pv(MAX_PLY + 1);
     int score;
 
     std::memset(PawnHash, 0, sizeof(PawnHash));
@@ -392,6 +400,7 @@ void bestmove(const Position& pos, const Limits& lim, const zobrist::GameStack&
     const auto start = high_resolution_clock::now();
 
     uci::ui.clear();
+    tt::new_search();
     signal = 0;
     std::vector<int> iteration(Threads, 0);
     gameStack.resize(Threads);
@@ -404,7 +413,10 @@ void bestmove(const Position& pos, const Limits& lim, const zobrist::GameStack&
         gameStack[i] = initialGameStack;
         nodeCount[i] = 0;
 
-        // Start searching thread
+        // Start searching thread. Each thread gets its own copy of the root position, because
+        // Position computes some fields lazily, which is not thread safe. The copy is made on the
+        // thread's stack, as std::thread would store it on the heap, where C++14 does not honour
+        // the cache line alignment of Position.
         threads.emplace_back(iterate, std::cref(pos), std::cref(lim), std::cref(initialGameStack),
                              std::ref(iteration), i);
     }
@@ -25,7 +25,7 @@ struct Limits {
 };
 
 template<bool Qsearch = false>
-int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::vector<move_t>& pv);
+int recurse(const Position& pos, int ply, int depth, int alpha, int beta, std::vector<move16_t>& pv);
 
 void bestmove(const Position& pos, const Limits& lim, const zobrist::GameStack& gameStack);
 
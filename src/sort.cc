@@ -20,6 +20,9 @@ namespace search {
 
 thread_local History H;
 
+// Number of captures (or check escapes) sorted at once, the others are picked (see test::picker)
+const size_t SortLimit = 2;
+
 void History::clear()
 {
     std::memset(table, 0, sizeof(table));
@@ -42,81 +45,146 @@ void History::update(Move m, int bonus)
         t = -Max;
 }
 
-void Selector::generate(const Position& pos, int depth)
+// The TT move must be legal, and among the moves that the following stages would generate
+bool Selector::tt_move_ok() const
 {
-    move_t *it = moves;
+    if (!ttMove)
+        return false;
 
-    if (pos.checkers())
-        it = gen::check_escapes(pos, it, depth > 0);
-    else {
-        const Color us = pos.turn();
-        const bitboard_t pieceTargets = depth > 0 ? ~pos.by_color(us) : pos.by_color(~us);
-        const bitboard_t pawnTargets = pieceTargets | ep_square_bb(pos) | bb::rank(relative_rank(us,
-                                       RANK_8));
+    const Move m(pos, ttMove);
 
-        it = gen::piece_moves(pos, it, pieceTargets);
-        it = gen::pawn_moves(pos, it, pawnTargets, depth > 0);
+    if (!gen::is_legal(pos, m))
+        return false;
 
-        if (depth > 0)
-            it = gen::castling_moves(pos, it);
+    // The qsearch only generates queen promotions, and only captures when not in check
+    return depth > 0 || ((m.prom == NB_PIECE || m.prom == QUEEN)
+                         && (pos.checkers() || m.is_capture()));
+}
+
+// Append the moves of the next stage (except the TT move, already done) to moves[]. Returns false
+// when there are no more stages.
+bool Selector::next_stage()
+{
+    const Color us = pos.turn();
+    const size_t begin = list.cnt;
+    const int generated = stage;
+    smove_t *it = list.end();
+
+    switch (stage) {
+    case TT_MOVE:
+        if (tt_move_ok()) {
+            list.moves[list.cnt++] = scored(Move(pos, ttMove), +INF);
+            sorted = list.cnt;
+        } else
+            ttMove = 0;
+
+        stage = pos.checkers() ? ESCAPES : CAPTURES;
+        return true;
+
+    case ESCAPES:
+        it = gen::check_escapes(pos, it, depth > 0);
+        stage = NB_STAGE;
+        break;
+
+    case CAPTURES:
+        it = gen::piece_moves(pos, it, pos.by_color(~us));
+        it = gen::pawn_moves(pos, it, pos.by_color(~us) | ep_square_bb(pos)
+                             | bb::rank(relative_rank(us, RANK_8)), depth > 0);
+        stage = depth > 0 ? QUIETS : depth == 0 ? QUIET_CHECKS : NB_STAGE;
+        break;
+
+    case QUIET_CHECKS:
+        it = gen::quiet_checks(pos, it);
+        stage = NB_STAGE;
+        break;
+
+    case QUIETS:
+        it = gen::piece_moves(pos, it, ~pieces(pos));
+        it = gen::pawn_moves(pos, it, ~pieces(pos) & ~ep_square_bb(pos)
+                             & ~bb::rank(relative_rank(us, RANK_8)));
+        it = gen::castling_moves(pos, it);
+        stage = NB_STAGE;
+        break;
+
+    default:
+        return false;
     }
 
-    cnt = it - moves;
+    list.resize(it);
+    score(begin);
+
+    // Captures and check escapes are few, and mostly all searched: sort the best of them once,
+    // and pick the others if needed. Quiet moves are picked lazily, as most nodes cut off early.
+    if (generated == ESCAPES || generated == CAPTURES)
+        sorted = list.sort(begin, SortLimit);
+
+    return true;
 }
 
-void Selector::score(const Position& pos, move_t ttMove)
+void Selector::score(size_t begin)
 {
-    for (size_t i = 0; i < cnt; i++) {
-        if (moves[i] == ttMove)
-            scores[i] = +INF;
-        else {
-            const Move m(moves[i]);
+    // Remove the TT move, which was already selected
+    size_t end = begin;
 
-            if (m.is_capture(pos)) {
-                const int see = m.see(pos);
-                scores[i] = see >= 0 ? see + History::Max : see - History::Max;
-            } else
-                scores[i] = H.get(m);
-        }
+    for (size_t i = begin; i < list.cnt; i++)
+        if (compact(list.moves[i]) != ttMove)
+            list.moves[end++] = list.moves[i];
+
+    list.cnt = end;
+
+    for (size_t i = begin; i < list.cnt; i++) {
+        const Move m(list.moves[i]);
+
+        if (m.is_capture()) {
+            const int see = m.see(pos);
+            list.moves[i] = scored(m, see >= 0 ? see + History::Max : see - History::Max);
+        } else
+            list.moves[i] = scored(m, H.get(m));
     }
 }
 
-Selector::Selector(const Position& pos, int depth, move_t ttMove)
+Selector::Selector(const Position& p, int d, move16_t tt)
+    : idx(0), pos(p), depth(d), ttMove(tt), stage(TT_MOVE), sorted(0)
 {
-    generate(pos, depth);
-    score(pos, ttMove);
-    idx = 0;
 }
 
-Move Selector::select(const Position& pos, int& see)
+bool Selector::done()
 {
-    int maxScore = -INF;
-    size_t swapIdx = idx;
+    while (idx == list.cnt)
+        if (!next_stage())
+            return true;
 
-    for (size_t i = idx; i < cnt; i++)
-        if (scores[i] > maxScore) {
-            maxScore = scores[i];
-            swapIdx = i;
-        }
+    return false;
+}
+
+Move Selector::select(int& see)
+{
+    assert(idx < list.cnt);
+
+    while (true) {
+        list.pick(idx, sorted);
 
-    if (swapIdx != idx) {
-        std::swap(moves[idx], moves[swapIdx]);
-        std::swap(scores[idx], scores[swapIdx]);
+        // Only bad captures left: play quiet moves first
+        if (score_of(list.moves[idx]) < History::Max && (stage == QUIETS || stage == QUIET_CHECKS))
+            next_stage();
+        else
+            break;
     }
 
-    const Move m(moves[idx]);
+    const Move m(list.moves[idx]);
+    const int score = score_of(list.moves[idx++]);
 
-    if (m.is_capture(pos)) {
-        if (scores[idx] >= History::Max)
-            see = scores[idx] - History::Max;
+    if (m.is_capture()) {
+        if (score >= History::Max)
+            see = score - History::Max;
         else {
-            assert(scores[idx] < -History::Max);
-            see = scores[idx] + History::Max;
+            assert(score < -History::Max);
+            see = score + History::Max;
         }
     } else
         see = m.see(pos);
 
-    return moves[idx++];
+    return m;
 }
 
 }    // namespace search
@@ -16,19 +16,30 @@ private:
 
 extern thread_local History H;
 
+// Staged move picker: the TT move first, without generating anything, then captures (and
+// promotions), then quiet moves, which are only generated once good captures are exhausted. The
+// qsearch stops after captures (or check escapes), except at depth 0 where quiet checks follow.
 class Selector {
 public:
-    Selector(const Position& pos, int depth, move_t ttMove);
-    Move select(const Position& pos, int& see);
-    bool done() const { return idx == cnt; }
+    Selector(const Position& pos, int depth, move16_t ttMove);
+    Move select(int& see);
+    bool done();
 
-    move_t moves[MAX_MOVES];
-    int scores[MAX_MOVES];
-    size_t cnt, idx;
+    MoveList list;
+    size_t idx;
 
 private:
-    void generate(const Position& pos, int depth);
-    void score(const Position& pos, move_t ttMove);
+    enum {TT_MOVE, ESCAPES, CAPTURES, QUIET_CHECKS, QUIETS, NB_STAGE};
+
+    const Position& pos;
+    const int depth;
+    move16_t ttMove;
+    int stage;    // next stage to generate
+    size_t sorted;    // list.moves[idx, sorted) is sorted
+
+    bool tt_move_ok() const;
+    bool next_stage();
+    void score(size_t begin);
 };
 
 }    // namespace search
@@ -13,39 +13,128 @@
  * You should have received a copy of the GNU General Public License along with this program. If
  * not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>    // std::find, std::copy, std::min, std::stable_sort
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include "epd.h"
 #include "test.h"
 #include "search.h"
+#include "sort.h"
+#include "tt.h"
 #include "gen.h"
 #include "uci.h"
 
-namespace test {
+namespace {
+
+const std::string Fens[] = {
+    "r1bqkbnr/pp1ppppp/2n5/2p5/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "1rbqk1nr/p3ppbp/2np2p1/2p5/1p2PP2/3PB1P1/PPPQ2BP/R2NK1NR b KQk - 0 1",
+    "r1bqk2r/pp1p1ppp/2n1pn2/2p5/1bPP4/2NBP3/PP2NPPP/R1BQK2R b KQkq - 0 1",
+    "rnb1kb1r/ppp2ppp/1q2p3/4P3/2P1Q3/5N2/PP1P1PPP/R1B1KB1R b KQkq - 0 1",
+    "r1b2rk1/pp2nppp/1b2p3/3p4/3N1P2/2P2NP1/PP3PBP/R3R1K1 b - - 0 1",
+    "n1q1r1k1/3b3n/p2p1bp1/P1pPp2p/2P1P3/2NBB2P/3Q1PK1/1R4N1 b - - 0 1",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "2r5/8/1n6/1P1p1pkp/p2P4/R1P1PKP1/8/1R6 w - - 0 1",
+    "r2q1rk1/1b1nbppp/4p3/3pP3/p1pP4/PpP2N1P/1P3PP1/R1BQRNK1 b - - 0 1",
+    "6k1/5pp1/7p/p1p2n1P/P4N2/6P1/1P3P1K/8 w - - 0 35",
+    "r4rk1/1pp1q1pp/p2p4/3Pn3/1PP1Pp2/P7/3QB1PP/2R2RK1 b - - 0 1"
+};
+
+uint64_t perft(Position& pos, int depth, test::PerftMode mode)
+{
+    return mode == test::MAKE_UNDO ? gen::perft_undo<false>(pos, depth)
+           : mode == test::BULK_HASH ? gen::perft_fast<false>(pos, depth)
+           : gen::perft<false>(pos, depth);
+}
 
-uint64_t bench(bool perft, int depth, int threads)
+// Perft split in subtrees two plies down, that threads take in order from a shared counter, so
+// that idle threads steal the remaining work. The divide is printed in root move order, as in
+// gen::perft(), followed by the nodes and time of each thread.
+uint64_t parallel_perft(const Position& pos, int depth, int threads, test::PerftMode mode)
 {
-    const std::string fens[] = {
-        "r1bqkbnr/pp1ppppp/2n5/2p5/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 1",
-        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
-        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
-        "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
-        "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
-        "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
-        "1rbqk1nr/p3ppbp/2np2p1/2p5/1p2PP2/3PB1P1/PPPQ2BP/R2NK1NR b KQk - 0 1",
-        "r1bqk2r/pp1p1ppp/2n1pn2/2p5/1bPP4/2NBP3/PP2NPPP/R1BQK2R b KQkq - 0 1",
-        "rnb1kb1r/ppp2ppp/1q2p3/4P3/2P1Q3/5N2/PP1P1PPP/R1B1KB1R b KQkq - 0 1",
-        "r1b2rk1/pp2nppp/1b2p3/3p4/3N1P2/2P2NP1/PP3PBP/R3R1K1 b - - 0 1",
-        "n1q1r1k1/3b3n/p2p1bp1/P1pPp2p/2P1P3/2NBB2P/3Q1PK1/1R4N1 b - - 0 1",
-        "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
-        "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
-        "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
-        "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
-        "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
-        "2r5/8/1n6/1P1p1pkp/p2P4/R1P1PKP1/8/1R6 w - - 0 1",
-        "r2q1rk1/1b1nbppp/4p3/3pP3/p1pP4/PpP2N1P/1P3PP1/R1BQRNK1 b - - 0 1",
-        "6k1/5pp1/7p/p1p2n1P/P4N2/6P1/1P3P1K/8 w - - 0 35",
-        "r4rk1/1pp1q1pp/p2p4/3Pn3/1PP1Pp2/P7/3QB1PP/2R2RK1 b - - 0 1"
+    struct Task {
+        size_t root;    // index of the root move
+        move_t m1, m2;
+    };
+
+    MoveList rootList;
+    rootList.resize(gen::all_moves(pos, rootList.end()));
+    std::vector<Task> tasks;
+    Position after;
+
+    for (size_t i = 0; i < rootList.cnt; i++) {
+        after.set(pos, Move(rootList.moves[i]));
+        MoveList list;
+        list.resize(gen::all_moves(after, list.end()));
+
+        for (const smove_t em : list)
+            tasks.push_back({i, move_t(rootList.moves[i]), move_t(em)});
+    }
+
+    std::vector<uint64_t> results(tasks.size()), threadNodes(threads);
+    std::vector<int64_t> threadTime(threads);
+    std::atomic<size_t> next(0);
+
+    const auto worker = [&](int threadId) {
+        Position p1, p2;
+        Clock clock;
+        clock.reset();
+
+        for (size_t t; (t = next++) < tasks.size(); ) {
+            p1.set(pos, Move(tasks[t].m1));
+            p2.set(p1, Move(tasks[t].m2));
+            results[t] = perft(p2, depth - 2, mode);
+            threadNodes[threadId] += results[t];
+        }
+
+        threadTime[threadId] = clock.elapsed();
     };
 
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(worker, i);
+
+    worker(0);
+
+    for (auto& w : workers)
+        w.join();
+
+    // Divide, in root move order
+    std::vector<uint64_t> divide(rootList.cnt);
+    uint64_t result = 0;
+
+    for (size_t t = 0; t < tasks.size(); t++) {
+        divide[tasks[t].root] += results[t];
+        result += results[t];
+    }
+
+    for (size_t i = 0; i < rootList.cnt; i++)
+        std::cout << Move(rootList.moves[i]).to_string() << '\t' << divide[i] << std::endl;
+
+    for (int i = 0; i < threads; i++)
+        std::cout << "thread " << i << '\t' << threadNodes[i] << " nodes\t" << threadTime[i]
+                  << "ms" << std::endl;
+
+    return result;
+}
+
+}    // namespace
+
+namespace test {
+
+uint64_t bench(bool perft, int depth, int threads, PerftMode mode)
+{
     uint64_t result = 0, nodes;
     search::Limits lim;
     lim.depth = depth;
@@ -56,14 +145,17 @@ uint64_t bench(bool perft, int depth, int threads)
     Clock clock;
     clock.reset();
 
-    for (const std::string& fen : fens) {
+    for (const std::string& fen : Fens) {
         pos.set(fen);
         gameStack.clear();
         gameStack.push(pos.key());
         print(pos);
 
         if (perft) {
-            nodes = gen::perft(pos, depth);
+            nodes = threads > 1 && depth >= 3 ? parallel_perft(pos, depth, threads, mode)
+                    : mode == MAKE_UNDO ? gen::perft_undo(pos, depth)
+                    : mode == BULK_HASH ? gen::perft_fast(pos, depth)
+                    : gen::perft(pos, depth);
             std::cout << "perft(" << depth << ") = " << nodes << std::endl;
         } else {
             search::bestmove(pos, lim, gameStack);
@@ -82,6 +174,395 @@ uint64_t bench(bool perft, int depth, int threads)
     return result;
 }
 
+int suite(const std::string& fileName, int depth, int threads)
+{
+    const epd::File file(fileName);
+
+    if (!file.ok()) {
+        std::cout << "cannot open " << fileName << std::endl;
+        return -1;
+    }
+
+    std::vector<std::pair<const char *, const char *>> lines;
+
+    epd::for_each_line(file, 1, [&](int, const char *begin, const char *end) {
+        lines.emplace_back(begin, end);
+    });
+
+    search::Limits lim;
+    lim.depth = depth;
+    search::Threads = threads;
+    Position pos;
+    epd::Ops ops;
+    zobrist::GameStack gameStack;
+    int solved = 0;
+
+    for (const auto& line : lines) {
+        epd::parse(line.first, line.second, pos, &ops);
+        gameStack.clear();
+        gameStack.push(pos.key());
+        search::bestmove(pos, lim, gameStack);
+
+        const move16_t m = uci::ui.best_move();
+        const bool ok = (ops.bm.empty()
+                         || std::find(ops.bm.begin(), ops.bm.end(), m) != ops.bm.end())
+                        && std::find(ops.am.begin(), ops.am.end(), m) == ops.am.end();
+        solved += ok;
+
+        std::cout << (ok ? "solved\t" : "failed\t") << ops.id << std::endl;
+    }
+
+    std::cout << "solved " << solved << " / " << lines.size() << std::endl;
+
+    return solved;
+}
+
+int perft_suite(const std::string& fileName, int threads, PerftMode mode)
+{
+    const epd::File file(fileName);
+
+    if (!file.ok()) {
+        std::cout << "cannot open " << fileName << std::endl;
+        return -1;
+    }
+
+    std::vector<std::pair<const char *, const char *>> lines;
+    std::vector<epd::Ops> ops;
+
+    epd::for_each_line(file, 1, [&](int, const char *begin, const char *end) {
+        Position pos;
+        ops.emplace_back();
+        epd::parse(begin, end, pos, &ops.back());
+        lines.emplace_back(begin, end);
+    });
+
+    // One task per (position, depth), deepest first so that the long ones start early
+    struct Task {
+        size_t line;
+        int depth;
+        uint64_t result;
+    };
+
+    std::vector<Task> tasks;
+
+    for (size_t i = 0; i < lines.size(); i++)
+        for (size_t d = 1; d < ops[i].perft.size(); d++)
+            if (ops[i].perft[d])
+                tasks.push_back({i, int(d), 0});
+
+    // A suite that checks nothing must not pass
+    if (tasks.empty()) {
+        std::cout << "no perft counts (Dn operations) in " << fileName << std::endl;
+        return -1;
+    }
+
+    std::stable_sort(tasks.begin(), tasks.end(), [](const Task& t1, const Task& t2) {
+        return t1.depth > t2.depth;
+    });
+
+    std::atomic<size_t> next(0);
+    Clock clock;
+    clock.reset();
+
+    const auto worker = [&]() {
+        Position pos;
+
+        for (size_t t; (t = next++) < tasks.size(); ) {
+            epd::parse(lines[tasks[t].line].first, lines[tasks[t].line].second, pos);
+            tasks[t].result = perft(pos, tasks[t].depth, mode);
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (auto& w : workers)
+        w.join();
+
+    const auto elapsed = clock.elapsed() + 1;
+
+    // Report mismatches in file order
+    std::stable_sort(tasks.begin(), tasks.end(), [](const Task& t1, const Task& t2) {
+        return t1.line < t2.line || (t1.line == t2.line && t1.depth < t2.depth);
+    });
+
+    uint64_t nodes = 0;
+    int mismatches = 0;
+
+    for (const Task& t : tasks) {
+        const uint64_t expected = ops[t.line].perft[t.depth];
+        nodes += t.result;
+
+        if (t.result != expected) {
+            mismatches++;
+            std::cout << "mismatch\t" << std::string(lines[t.line].first, lines[t.line].second)
+                      << "\tD" << t.depth << ": expected " << expected << ", got " << t.result
+                      << std::endl;
+        }
+    }
+
+    std::cout << "positions: " << lines.size() << "\tchecks: " << tasks.size()
+              << "\tmismatches: " << mismatches << "\nnodes: " << nodes << "\ttime: " << elapsed
+              << "ms\tkn/s: " << nodes / elapsed << std::endl;
+
+    return mismatches;
+}
+
+uint64_t sliders(uint64_t lookups)
+{
+    // Random occupancies with ~1/4 density, and random squares
+    const int Size = 4096;
+    bitboard_t occ[Size];
+    Square sq[Size];
+    zobrist::PRNG prng;
+
+    for (int i = 0; i < Size; i++) {
+        occ[i] = prng.rand() & prng.rand();
+        sq[i] = Square(prng.rand() % NB_SQUARE);
+    }
+
+    uint64_t result = 0;
+    Clock clock;
+    clock.reset();
+
+    for (uint64_t i = 0; i < lookups; i++) {
+        const int j = i & (Size - 1);
+        result ^= bb::rattacks(sq[j], occ[j]) ^ bb::battacks(sq[j], occ[j]);
+    }
+
+    std::cout << "lookups/ms: " << 2 * lookups / (clock.elapsed() + 1) << std::endl;
+
+    return result;
+}
+
+uint64_t picker(uint64_t iterations)
+{
+    // All moves of the bench positions, scored like the Selector does (random history scores for
+    // quiet moves), and their captures alone. Long unsorted lists are the case that matters for
+    // quiet moves. Captures are short, and mostly all searched.
+    std::vector<MoveList> lists, captureLists;
+    Position pos;
+    zobrist::PRNG prng;
+    size_t moves = 0, captures = 0;
+
+    for (const std::string& fen : Fens) {
+        pos.set(fen);
+        MoveList list, captureList;
+        list.resize(gen::all_moves(pos, list.end()));
+
+        for (smove_t& sm : list) {
+            const Move m(sm);
+
+            if (m.is_capture()) {
+                const int see = m.see(pos);
+                sm = scored(m, see >= 0 ? see + search::History::Max : see - search::History::Max);
+                captureList.moves[captureList.cnt++] = sm;
+            } else
+                sm = scored(m, int(prng.rand() % (2 * search::History::Max + 1))
+                            - search::History::Max);
+        }
+
+        lists.push_back(list);
+        captureLists.push_back(captureList);
+        moves += list.cnt;
+        captures += captureList.cnt;
+    }
+
+    std::cout << "positions: " << lists.size() << "\tmoves/list: "
+              << double(moves) / lists.size() << "\tcaptures/list: "
+              << double(captures) / lists.size() << std::endl;
+
+    // Sort the best sortLimit moves at once (if not 0), then pick the first k moves (k = 0
+    // measures copying the list)
+    uint64_t checksum = 0;
+    const auto run = [&](const std::string& name, const std::vector<MoveList>& src, size_t k,
+                         size_t sortLimit) {
+        MoveList list;
+        Clock clock;
+        clock.reset();
+
+        for (uint64_t i = 0; i < iterations; i++)
+            for (const MoveList& l : src) {
+                std::copy(l.moves, l.moves + l.cnt, list.moves);
+                list.cnt = l.cnt;
+                const size_t sorted = sortLimit ? list.sort(0, sortLimit) : 0;
+
+                for (size_t idx = 0; idx < std::min(k, list.cnt); idx++)
+                    list.pick(idx, sorted);
+
+                checksum += list.moves[std::min(k, list.cnt) / 2];
+            }
+
+        std::cout << name << "\t" << clock.elapsed() << "ms" << std::endl;
+    };
+
+    run("copy", lists, 0, 0);
+    run("pick 1", lists, 1, 0);
+    run("pick 4", lists, 4, 0);
+    run("pick all", lists, MAX_MOVES, 0);
+    run("sort", lists, MAX_MOVES, MAX_MOVES);
+
+    // Captures: pick them all, or sort the first few (or all), and pick the rest
+    run("captures: copy", captureLists, 0, 0);
+
+    for (size_t limit : {size_t(0), size_t(2), size_t(4), size_t(8), size_t(MAX_MOVES)})
+        for (size_t k : {size_t(1), size_t(MAX_MOVES)})
+            run("captures: sort " + std::to_string(limit) + ", pick " + std::to_string(k),
+                captureLists, k, limit);
+
+    return checksum;
+}
+
+bool attacks(uint64_t iterations)
+{
+    Position pos;
+    bitboard_t checksum = 0;
+    bool ok = true;
+
+    for (const std::string& fen : Fens) {
+        pos.set(fen);
+        bitboard_t occ = pieces(pos);
+
+        // Check that both methods agree
+        for (Color c = WHITE; c <= BLACK; ++c) {
+            bitboard_t expected = 0, fss = pieces(pos, c, ROOK, QUEEN);
+
+            while (fss)
+                expected |= bb::rattacks(bb::pop_lsb(fss), occ);
+
+            fss = pieces(pos, c, BISHOP, QUEEN);
+
+            while (fss)
+                expected |= bb::battacks(bb::pop_lsb(fss), occ);
+
+            ok &= expected == (bb::rattacks_all(pieces(pos, c, ROOK, QUEEN), occ)
+                               | bb::battacks_all(pieces(pos, c, BISHOP, QUEEN), occ));
+        }
+
+        // One magic lookup per slider
+        Clock clock;
+        clock.reset();
+
+        for (uint64_t i = 0; i < iterations; i++) {
+            asm volatile("" : "+r"(occ));    // prevent hoisting out of the loop
+
+            for (Color c = WHITE; c <= BLACK; ++c) {
+                bitboard_t fss = pieces(pos, c, ROOK, QUEEN);
+
+                while (fss)
+                    checksum += bb::rattacks(bb::pop_lsb(fss), occ);
+
+                fss = pieces(pos, c, BISHOP, QUEEN);
+
+                while (fss)
+                    checksum += bb::battacks(bb::pop_lsb(fss), occ);
+            }
+        }
+
+        const auto loopTime = clock.elapsed();
+
+        // Occluded fills over the whole set
+        clock.reset();
+
+        for (uint64_t i = 0; i < iterations; i++) {
+            asm volatile("" : "+r"(occ));
+
+            for (Color c = WHITE; c <= BLACK; ++c) {
+                checksum += bb::rattacks_all(pieces(pos, c, ROOK, QUEEN), occ);
+                checksum += bb::battacks_all(pieces(pos, c, BISHOP, QUEEN), occ);
+            }
+        }
+
+        const auto setwiseTime = clock.elapsed();
+        const int sliders = bb::count(pos.by_piece(BISHOP) | pos.by_piece(ROOK)
+                                      | pos.by_piece(QUEEN));
+
+        std::cout << fen << "\tsliders = " << sliders << "\tloop = " << loopTime
+                  << "ms\tsetwise = " << setwiseTime << "ms" << std::endl;
+    }
+
+    std::cout << "checksum = " << checksum << std::endl;
+
+    return ok;
+}
+
+bool tt_stress(int threads, uint64_t iterations)
+{
+    // A small pool of keys, all in the same 4 buckets (the table has 2^14 buckets, selected by the
+    // top 14 bits of the key), so that threads keep overwriting each other's entries. The low 16
+    // bits (checked by the TT) are distinct. Score, eval and move are a function of the key, to
+    // check what reads return.
+    zobrist::PRNG prng;
+    std::vector<uint64_t> keys(64);
+
+    for (size_t i = 0; i < keys.size(); i++)
+        keys[i] = uint64_t(i % 4) << 50 | (prng.rand() >> 14 & ~uint64_t(0xffff)) | i;
+
+    tt::resize(1);
+    std::atomic<uint64_t> reads(0), hits(0), accepted(0);
+
+    const auto worker = [&](int threadId) {
+        zobrist::PRNG local;
+        local.init(threadId + 1);
+        uint64_t r = 0, h = 0, a = 0;
+
+        for (uint64_t i = 0; i < iterations; i++) {
+            const uint64_t rnd = local.rand();
+            const uint64_t key = keys[rnd % keys.size()];
+            tt::Entry e;
+
+            if (rnd & (1ULL << 32)) {
+                e.key = key;
+                e.score = int16_t(key >> 16);
+                e.eval = int16_t(key >> 32);
+                e.move = int16_t(key >> 48);
+                e.depth = (rnd >> 40) % MAX_DEPTH;
+                e.bound = (rnd >> 48) % 3;
+                tt::write(e);
+            } else {
+                r++;
+
+                if (tt::read(key, e)) {
+                    h++;
+                    a += e.score != int16_t(key >> 16) || e.eval != int16_t(key >> 32)
+                         || e.move != int16_t(key >> 48);
+                }
+            }
+        }
+
+        reads += r;
+        hits += h;
+        accepted += a;
+    };
+
+    Clock clock;
+    clock.reset();
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(worker, i);
+
+    worker(0);
+
+    for (auto& t : workers)
+        t.join();
+
+    const auto elapsed = clock.elapsed();
+    const size_t rejected = tt::corrupted(keys);
+
+    std::cout << "operations: " << threads * iterations << "\treads: " << reads
+              << "\thits: " << hits << "\ttime: " << elapsed << "ms\n"
+              << "torn entries: " << rejected << " detected\t" << accepted << " accepted"
+              << std::endl;
+
+    tt::clear();
+    return accepted == 0;
+}
+
 bool see(bool verbose)
 {
     struct TestSEE {
@@ -1,8 +1,19 @@
 #pragma once
+#include <cstdint>
+#include <string>
 
 namespace test {
 
-uint64_t bench(bool perft, int depth, int threads);
+// Perft variants: gen::perft(), gen::perft_undo() and gen::perft_fast()
+enum PerftMode {COPY_MAKE, MAKE_UNDO, BULK_HASH};
+
+uint64_t bench(bool perft, int depth, int threads, PerftMode mode = COPY_MAKE);
+int suite(const std::string& fileName, int depth, int threads);    // -1: no file
+int perft_suite(const std::string& fileName, int threads, PerftMode mode);    // -1: nothing checked
+uint64_t sliders(uint64_t lookups);
+uint64_t picker(uint64_t iterations);
+bool attacks(uint64_t iterations);
+bool tt_stress(int threads, uint64_t iterations);    // concurrent reads and writes of the TT
 bool see(bool verbose = false);
 
 }    // namespace test
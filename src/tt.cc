@@ -13,11 +13,129 @@
  * You should have received a copy of the GNU General Public License along with this program. If
  * not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>    // std::min, std::none_of
+#include <cstring>    // std::memset()
+#include <thread>
+#include <sys/mman.h>    // mmap(), madvise()
 #include "tt.h"
 
 namespace tt {
 
-std::vector<Entry> table(1024 * 1024 / sizeof(Entry), 0);    // default=1MB (min Hash)
+namespace {
+
+const size_t HugePage = 2 << 20;
+
+void *mapping = nullptr;    // whole mapping, buckets may start further (huge page alignment)
+size_t mappingSize = 0;
+Bucket *buckets;
+size_t bucketCount;
+uint8_t generation;    // 6 bits
+
+// Multiply-shift maps the key to [0, bucketCount), for any bucketCount: the high bits of the key
+// select the bucket.
+size_t index(uint64_t key)
+{
+    return size_t((unsigned __int128)key * bucketCount >> 64);
+}
+
+Bucket& bucket(uint64_t key)
+{
+    return buckets[index(key)];
+}
+
+uint64_t pack(const Entry& e)
+{
+    return uint64_t(uint16_t(e.score)) | uint64_t(uint16_t(e.eval)) << 16
+           | uint64_t(uint16_t(e.move)) << 32 | uint64_t(uint8_t(e.depth)) << 48
+           | uint64_t(e.bound) << 56 | uint64_t(e.generation) << 58;
+}
+
+Entry unpack(uint64_t key, uint64_t data)
+{
+    Entry e;
+    e.key = key;
+    e.score = int16_t(data);
+    e.eval = int16_t(data >> 16);
+    e.move = int16_t(data >> 32);
+    e.depth = int8_t(data >> 48);
+    e.bound = (data >> 56) & 3;
+    e.generation = data >> 58;
+    return e;
+}
+
+uint16_t check(uint64_t key, uint64_t data)
+{
+    const uint32_t fold = uint32_t(data ^ data >> 32);
+    return uint16_t(key ^ fold ^ fold >> 16);
+}
+
+// An empty entry has data = 0. So does a valid one with nothing useful in it: ignore both.
+bool match(uint64_t key, uint64_t data, uint16_t chk)
+{
+    return data && chk == check(key, data);
+}
+
+void store(Bucket& b, int i, const Entry& e)
+{
+    const uint64_t data = pack(e);
+    b.data[i] = data;
+    b.check[i] = check(e.key, data);
+}
+
+// Replacement value, of a non empty entry: deep entries of recent searches are worth keeping
+int value(uint64_t data)
+{
+    const int age = (generation - int(data >> 58)) & 63;
+    return int8_t(data >> 48) - 8 * age;
+}
+
+// Map size bytes of zeroed memory, in huge pages if possible. Pages are not touched: physical
+// memory is allocated on first write, on the NUMA node of the thread that writes. The previous
+// mapping is only released once the new one succeeds: returns nullptr (and keeps it) otherwise.
+Bucket *map(size_t size)
+{
+    void *newMapping = MAP_FAILED;
+    size_t newSize = size;
+    uintptr_t p = 0;
+
+#ifdef MAP_HUGETLB
+    // Reserved huge pages (vm.nr_hugepages), if the system has enough of them
+    if (size % HugePage == 0) {
+        newMapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        p = uintptr_t(newMapping);
+    }
+#endif
+
+    if (newMapping == MAP_FAILED) {
+        // Otherwise, ask for transparent huge pages, which must be aligned on a huge page
+        const size_t align = size >= HugePage ? HugePage : alignof(Bucket);
+        newSize = size + align;
+        newMapping = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                          -1, 0);
+
+        if (newMapping == MAP_FAILED)
+            return nullptr;
+
+        p = (uintptr_t(newMapping) + align - 1) & ~uintptr_t(align - 1);
+
+#ifdef MADV_HUGEPAGE
+        if (size >= HugePage)
+            madvise((void *)p, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    if (mapping)
+        munmap(mapping, mappingSize);
+
+    mapping = newMapping;
+    mappingSize = newSize;
+    return (Bucket *)p;
+}
+
+const bool Initialized = (resize(1), true);    // default=1MB (min Hash)
+
+}    // namespace
 
 int score_to_tt(int score, int ply)
 {
@@ -33,24 +151,138 @@ int score_from_tt(int ttScore, int ply)
            : ttScore;
 }
 
-void clear()
+bool resize(size_t mb, int threads)
 {
-    std::fill(table.begin(), table.end(), Entry(0));
+    const size_t count = (mb << 20) / sizeof(Bucket);
+    assert(count > 0);    // index() needs at least one bucket
+    Bucket *b = map(count * sizeof(Bucket));
+
+    if (!b)
+        return false;
+
+    buckets = b;
+    bucketCount = count;
+    clear(threads);    // first touch
+    return true;
+}
+
+void clear(int threads)
+{
+    // Each thread clears a contiguous chunk, which also spreads the pages over NUMA nodes
+    const size_t count = bucketCount;
+    const auto worker = [=](int i) {
+        const size_t begin = count * i / threads, end = count * (i + 1) / threads;
+        std::memset((void *)(buckets + begin), 0, (end - begin) * sizeof(Bucket));
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(worker, i);
+
+    worker(0);
+
+    for (auto& t : workers)
+        t.join();
+
+    generation = 0;
+}
+
+void new_search()
+{
+    generation = (generation + 1) & 63;
+}
+
+int hashfull()
+{
+    // Sample the first 1000 entries (or so)
+    const size_t n = std::min(bucketCount, size_t(1000 / BucketSize));
+    int result = 0;
+
+    for (size_t i = 0; i < n; i++)
+        for (const uint64_t data : buckets[i].data)
+            result += data && (data >> 58) == generation;
+
+    return result * 1000 / int(n * BucketSize);
+}
+
+size_t corrupted(const std::vector<uint64_t>& keys)
+{
+    size_t result = 0;
+
+    for (size_t i = 0; i < bucketCount; i++)
+        for (int j = 0; j < BucketSize; j++) {
+            const uint64_t data = buckets[i].data[j];
+            const uint16_t chk = buckets[i].check[j];
+
+            result += data && std::none_of(keys.begin(), keys.end(), [&](uint64_t key) {
+                return index(key) == i && match(key, data, chk);
+            });
+        }
+
+    return result;
+}
+
+void prefetch(uint64_t key)
+{
+    __builtin_prefetch(&bucket(key));
 }
 
 bool read(uint64_t key, Entry& e)
 {
-    const size_t idx = key & (table.size() - 1);
-    e = table[idx];
-    return e.key == key;
+    Bucket& b = bucket(key);
+
+    for (int i = 0; i < BucketSize; i++) {
+        // Other threads may write the entry meanwhile: check a copy
+        const uint64_t data = b.data[i];
+
+        if (match(key, data, b.check[i])) {
+            e = unpack(key, data);
+
+            if (e.generation != generation) {
+                e.generation = generation;    // still useful: refresh
+                store(b, i, e);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
 }
 
 void write(const Entry& e)
 {
-    Entry& replace = table[e.key & (table.size() - 1)];
+    Bucket& b = bucket(e.key);
+    int replace = -1, replaceValue = 0;
+
+    for (int i = 0; i < BucketSize; i++) {
+        const uint64_t data = b.data[i];
+
+        if (match(e.key, data, b.check[i])) {
+            // Same position: keep a deeper entry, unless it is from a previous search
+            if (e.depth < int8_t(data >> 48) && (data >> 58) == generation)
+                return;
+
+            replace = i;
+            break;
+        }
+
+        // Empty slot: take it, rather than evict an entry
+        if (!data) {
+            replace = i;
+            break;
+        }
+
+        if (replace < 0 || value(data) < replaceValue) {
+            replace = i;
+            replaceValue = value(data);
+        }
+    }
 
-    if (e.key != replace.key || e.depth >= replace.depth)
-        replace = e;
+    Entry copy = e;
+    copy.generation = generation;
+    store(b, replace, copy);
 }
 
 }    // namespace tt
@@ -9,20 +9,43 @@ enum {LBOUND, EXACT, UBOUND};
 struct Entry {
     uint64_t key;
     int16_t score, eval, move;
-    int8_t depth, bound;
+    int8_t depth;
+    uint8_t bound : 2, generation : 6;
+};
 
-    Entry() = default;
-    Entry(uint64_t v) { key = v; }
+// Stored form of the entries: 10 bytes each, 6 per bucket. The data word packs generation:6,
+// bound:2, depth:8, move:16, eval:16, score:16. The check word is the low 16 bits of the key (the
+// high bits select the bucket), XORed with the 4 words of data, so that an entry torn by
+// concurrent writes (check of one, data of another) fails the check, and reads as a miss. This
+// lets all threads share the table without locking. With 16 check bits, about 6 in 65536 misses
+// read an entry of another position instead (false hit). Search verifies its move before playing
+// it, but uses its score and eval as they are, like any other hash collision.
+const int BucketSize = 6;
+
+struct alignas(64) Bucket {
+    uint64_t data[BucketSize];
+    uint16_t check[BucketSize];
 };
 
+static_assert(sizeof(Bucket) == 64, "a bucket must fill a cache line");
+
 // Adjust mate scores to plies from current position, instead of plies from root
 int score_to_tt(int score, int ply);
 int score_from_tt(int ttScore, int ply);
 
-void clear();
+// Allocate (in huge pages if possible) and clear the table, using threads to clear it. Returns
+// false if the allocation fails, and keeps the previous table.
+bool resize(size_t mb, int threads = 1);
+void clear(int threads = 1);
+void new_search();    // age the entries of previous searches
+int hashfull();    // permill of entries written by the current search
+
+// Number of entries that match none of keys: torn entries, if keys are all the keys written (for
+// testing).
+size_t corrupted(const std::vector<uint64_t>& keys);
+
+void prefetch(uint64_t key);
 bool read(uint64_t key, Entry& e);
 void write(const Entry& e);
 
-extern std::vector<Entry> table;
-
 }    // namespace tt
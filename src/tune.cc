@@ -13,11 +13,14 @@
  * You should have received a copy of the GNU General Public License along with this program. If
  * not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <cstring>    // std::memset()
-#include <fstream>
+#include <cstdlib>    // std::strtod()
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <cmath>
+#include "epd.h"
 #include "eval.h"
 #include "search.h"
 #include "tt.h"
@@ -27,7 +30,9 @@
 
 namespace {
 
-std::vector<std::string> fens;
+// Lines of the loaded file, pointing into its memory mapping, which therefore stays alive
+std::unique_ptr<epd::File> file;
+std::vector<std::pair<const char *, const char *>> fens;
 std::vector<double> scores;
 std::vector<double> qsearches;
 
@@ -37,10 +42,10 @@ void idle_loop(int depth, int threadId)
     std::memset(PawnHash, 0, sizeof(PawnHash));
 
     Position pos;
-    std::vector<move_t> pv(MAX_PLY + 1);
+    std::vector<move16_t> pv(MAX_PLY + 1);
 
     for (size_t i = threadId; i < fens.size(); i += search::Threads) {
-        pos.set(fens[i]);
+        epd::parse(fens[i].first, fens[i].second, pos);
         search::gameStack[threadId].clear();
         search::gameStack[threadId].push(pos.key());
         qsearches[i] = depth <= 0
@@ -54,24 +59,36 @@ void idle_loop(int depth, int threadId)
 
 namespace tune {
 
-void load(const std::string& fileName)
+void load(const std::string& fileName, int threads)
 {
     Clock c;
     c.reset();
 
     fens.clear();
     scores.clear();
+    file.reset(new epd::File(fileName));
 
-    std::ifstream f(fileName);
-    std::string s;
+    // Each thread collects the lines of its chunk of the file, then we concatenate them, in file
+    // order. Positions are parsed later, straight from the mapped file, by idle_loop().
+    std::vector<decltype(fens)> threadFens(threads);
+    std::vector<decltype(scores)> threadScores(threads);
 
-    while (std::getline(f, s)) {
-        const auto i = s.find(',');
+    epd::for_each_line(*file, threads, [&](int threadId, const char *begin, const char *end) {
+        const char *comma = std::find(begin, end, ',');
 
-        if (i != std::string::npos) {
-            fens.push_back(s.substr(0, i));
-            scores.push_back(std::stod(s.substr(i + 1)));
+        if (comma != end) {
+            // std::strtod() needs a null terminated string, which the mapped file is not
+            char buf[32] = {};
+            std::copy(comma + 1, std::min(end, comma + sizeof(buf)), buf);
+
+            threadFens[threadId].emplace_back(begin, comma);
+            threadScores[threadId].push_back(std::strtod(buf, nullptr));
         }
+    });
+
+    for (int i = 0; i < threads; i++) {
+        fens.insert(fens.end(), threadFens[i].begin(), threadFens[i].end());
+        scores.insert(scores.end(), threadScores[i].begin(), threadScores[i].end());
     }
 
     std::cout << "** loaded " << fens.size() << " positions in " << c.elapsed() / 1000.0 << "s\n";
@@ -84,8 +101,7 @@ void search(int depth, int threads, int hash)
 
     qsearches.resize(fens.size());
 
-    tt::table.resize(hash * 1024 * (1024 / sizeof(tt::Entry)), 0);
-    tt::clear();
+    tt::resize(std::max(hash, 1), threads);    // min 1MB, like the Hash option
 
     search::Threads = threads;
     search::gameStack.resize(threads);
@@ -4,7 +4,7 @@
 
 namespace tune {
 
-void load(const std::string& fileName);
+void load(const std::string& fileName, int threads);
 void search(int depth, int threads, int hash);
 void logistic();
 
@@ -97,8 +97,6 @@ std::chrono::milliseconds::rep Clock::elapsed()
 
 /* Eval */
 
-const eval_t Material[NB_PIECE] = {{N, N}, {B, B}, {R, R}, {Q, Q}, {0, 0}, {OP, EP}};
-
 bool score_ok(int score)
 {
     return std::abs(score) < MATE;
@@ -13,10 +13,10 @@ extern int64_t dbgCnt[2];
 #define ENABLE_OPERATORS(T) \
 inline constexpr T operator+(T v, int i) { return T(int(v) + i); } \
 inline constexpr T operator-(T v, int i) { return T(int(v) - i); } \
-inline T operator+=(T& v, int i) { return v = T(int(v) + i); } \
-inline T operator-=(T& v, int i) { return v = T(int(v) - i); } \
-inline T operator++(T& v) { return v = T(int(v) + 1); } \
-inline T operator--(T& v) { return v = T(int(v) - 1); }
+inline constexpr T operator+=(T& v, int i) { return v = T(int(v) + i); } \
+inline constexpr T operator-=(T& v, int i) { return v = T(int(v) - i); } \
+inline constexpr T operator++(T& v) { return v = T(int(v) + 1); } \
+inline constexpr T operator--(T& v) { return v = T(int(v) - 1); }
 
 /* Color, Piece */
 
@@ -26,7 +26,7 @@ enum Piece {KNIGHT, BISHOP, ROOK, QUEEN, KING, PAWN, NB_PIECE};
 ENABLE_OPERATORS(Color)
 ENABLE_OPERATORS(Piece)
 
-inline Color operator~(Color c) { return Color(c ^ BLACK); }
+inline constexpr Color operator~(Color c) { return Color(c ^ BLACK); }
 
 /* Rank, File, Square */
 
@@ -84,28 +84,28 @@ typedef int eval_t __attribute__ (( vector_size(8) ));
 struct eval_t {
     int v[NB_PHASE];
 
-    int operator[](int phase) const { return v[phase]; }
-    int op() const { return v[OPENING]; }
-    int eg() const { return v[ENDGAME]; }
-    int& op() { return v[OPENING]; }
-    int& eg() { return v[ENDGAME]; }
-
-    operator bool() const { return op() || eg(); }
-    bool operator==(eval_t e) const { return op() == e.op() && eg() == e.eg(); }
-    bool operator!=(eval_t e) const { return !(*this == e); }
-
-    eval_t operator+(eval_t e) const { return {op() + e.op(), eg() + e.eg()}; }
-    eval_t operator-(eval_t e) const { return {op() - e.op(), eg() - e.eg()}; }
-    eval_t operator*(int x) const { return {op() * x, eg() * x}; }
-    eval_t operator/(int x) const { return {op() / x, eg() / x}; }
-
-    eval_t& operator+=(eval_t e) { return op() += e.op(), eg() += e.eg(), *this; }
-    eval_t& operator-=(eval_t e) { return op() -= e.op(), eg() -= e.eg(), *this; }
-    eval_t& operator*=(int x) { return op() *= x, eg() *= x, *this; }
-    eval_t& operator/=(int x) { return op() /= x, eg() /= x, *this; }
+    constexpr int operator[](int phase) const { return v[phase]; }
+    constexpr int op() const { return v[OPENING]; }
+    constexpr int eg() const { return v[ENDGAME]; }
+    constexpr int& op() { return v[OPENING]; }
+    constexpr int& eg() { return v[ENDGAME]; }
+
+    constexpr operator bool() const { return op() || eg(); }
+    constexpr bool operator==(eval_t e) const { return op() == e.op() && eg() == e.eg(); }
+    constexpr bool operator!=(eval_t e) const { return !(*this == e); }
+
+    constexpr eval_t operator+(eval_t e) const { return {op() + e.op(), eg() + e.eg()}; }
+    constexpr eval_t operator-(eval_t e) const { return {op() - e.op(), eg() - e.eg()}; }
+    constexpr eval_t operator*(int x) const { return {op() * x, eg() * x}; }
+    constexpr eval_t operator/(int x) const { return {op() / x, eg() / x}; }
+
+    constexpr eval_t& operator+=(eval_t e) { return op() += e.op(), eg() += e.eg(), *this; }
+    constexpr eval_t& operator-=(eval_t e) { return op() -= e.op(), eg() -= e.eg(), *this; }
+    constexpr eval_t& operator*=(int x) { return op() *= x, eg() *= x, *this; }
+    constexpr eval_t& operator/=(int x) { return op() /= x, eg() /= x, *this; }
 };
 
-extern const eval_t Material[NB_PIECE];
+constexpr eval_t Material[NB_PIECE] = {{N, N}, {B, B}, {R, R}, {Q, Q}, {0, 0}, {OP, EP}};
 
 #define INF    32767
 #define MATE    32000
@@ -13,6 +13,7 @@
  * You should have received a copy of the GNU General Public License along with this program. If
  * not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>    // std::max
 #include <iostream>
 #include <sstream>
 #include <thread>
@@ -59,9 +60,15 @@ void setoption(std::istringstream& is)
     if (name == "UCI_Chess960")
         is >> std::boolalpha >> Chess960;
     else if (name == "Hash") {
+        const size_t oldHash = Hash;
         is >> Hash;
-        Hash = 1ULL << bb::msb(Hash);    // must be a power of two
-        tt::table.resize(Hash * 1024 * (1024 / sizeof(tt::Entry)), 0);
+        Hash = std::max<size_t>(Hash, 1);    // min 1, as advertised
+
+        if (!tt::resize(Hash, search::Threads)) {
+            std::cout << "info string cannot allocate " << Hash << "MB, keeping " << oldHash
+                      << "MB" << std::endl;
+            Hash = oldHash;
+        }
     } else if (name == "Threads")
         is >> search::Threads;
     else if (name == "Contempt")
@@ -143,10 +150,12 @@ void eval()
 void perft(std::istringstream& is)
 {
     int depth;
-    is >> depth;
+    std::string mode;
+    is >> depth >> mode;    // "perft <depth> fast": bulk counting and hashing
 
     print(pos);
-    std::cout << "score " << gen::perft(pos, depth) << std::endl;
+    const uint64_t nodes = mode == "fast" ? gen::perft_fast(pos, depth) : gen::perft(pos, depth);
+    std::cout << "score " << nodes << std::endl;
 }
 
 }    // namespace
@@ -170,7 +179,7 @@ void loop()
         else if (token == "isready")
             std::cout << "readyok" << std::endl;
         else if (token == "ucinewgame")
-            tt::clear();
+            tt::clear(search::Threads);
         else if (token == "position")
             position(is);
         else if (token == "go")
@@ -198,7 +207,7 @@ void Info::clear()
     clock.reset();
 }
 
-void Info::update(const Position& pos, int depth, int score, int nodes, std::vector<move_t>& pv,
+void Info::update(const Position& pos, int depth, int score, int nodes, std::vector<move16_t>& pv,
                   bool partial)
 {
     std::lock_guard<std::mutex> lk(mtx);
@@ -217,15 +226,15 @@ void Info::update(const Position& pos, int depth, int score, int nodes, std::vec
 
         os << "info depth " << depth << " score " << format_score(score)
            << " time " << elapsed << " nodes " << nodes
-           << " nps " << (1000 * nodes / elapsed) << " pv";
+           << " nps " << (1000 * nodes / elapsed) << " hashfull " << tt::hashfull() << " pv";
 
         Position p[2];
         int idx = 0;
         p[idx] = pos;
 
         for (int i = 0; pv[i]; i++) {
-            Move m(pv[i]);
-            os << ' ' << m.to_string(p[idx]);
+            const Move m(p[idx], pv[i]);
+            os << ' ' << m.to_string();
             p[idx ^ 1].set(p[idx], m);
             idx ^= 1;
         }
@@ -237,11 +246,19 @@ void Info::update(const Position& pos, int depth, int score, int nodes, std::vec
 void Info::print_bestmove(const Position& pos) const
 {
     std::lock_guard<std::mutex> lk(mtx);
-    std::cout << "bestmove " << bestMove.to_string(pos)
-              << " ponder " << ponderMove.to_string(pos) << std::endl;
+    const Move best(pos, bestMove);
+    Move ponder(0);
+
+    if (!best.null()) {
+        Position after;
+        after.set(pos, best);
+        ponder = Move(after, ponderMove);
+    }
+
+    std::cout << "bestmove " << best.to_string() << " ponder " << ponder.to_string() << std::endl;
 }
 
-Move Info::best_move() const
+move16_t Info::best_move() const
 {
     std::lock_guard<std::mutex> lk(mtx);
     return bestMove;
@@ -11,11 +11,11 @@ void loop();
 class Info {
 public:
     void clear();
-    void update(const Position& pos, int depth, int score, int nodes, std::vector<move_t>& pv,
+    void update(const Position& pos, int depth, int score, int nodes, std::vector<move16_t>& pv,
                 bool partial = false);
     void print_bestmove(const Position& pos) const;
 
-    Move best_move() const;
+    move16_t best_move() const;
 
     // Do not need synchronization
     Clock clock;  // read-only during search
@@ -23,7 +23,7 @@ public:
 
 private:
     // Require synchronization
-    Move bestMove, ponderMove;
+    move16_t bestMove, ponderMove;
     mutable std::mutex mtx;
 };
 
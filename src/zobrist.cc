@@ -18,16 +18,37 @@
 
 namespace {
 
-uint64_t Zobrist[NB_COLOR][NB_PIECE][NB_SQUARE];
-uint64_t ZobristCastling[NB_SQUARE];
-uint64_t ZobristEnPassant[(int)NB_SQUARE+1];
-uint64_t ZobristTurn;
-
-uint64_t rotate(uint64_t x, int k)
+struct Tables {
+    uint64_t Zobrist[NB_COLOR][NB_PIECE][NB_SQUARE];
+    uint64_t ZobristCastling[NB_SQUARE];
+    uint64_t ZobristEnPassant[(int)NB_SQUARE+1];
+    uint64_t ZobristTurn;
+};
+
+constexpr Tables init()
 {
-    return (x << k) | (x >> (64 - k));
+    Tables t {};
+    zobrist::PRNG prng;
+
+    for (Color c = WHITE; c <= BLACK; ++c)
+        for (Piece p = KNIGHT; p < NB_PIECE; ++p)
+            for (Square s = A1; s <= H8; ++s)
+                t.Zobrist[c][p][s] = prng.rand();
+
+    for (Square s = A1; s <= H8; ++s)
+        t.ZobristCastling[s] = prng.rand();
+
+    for (Square s = A1; s <= H8; ++s)
+        t.ZobristEnPassant[s] = prng.rand();
+
+    t.ZobristEnPassant[NB_SQUARE] = prng.rand();
+
+    t.ZobristTurn = prng.rand();
+    return t;
 }
 
+constexpr Tables T = init();
+
 }    // namespace
 
 namespace zobrist {
@@ -66,51 +87,13 @@ bool GameStack::repetition(int rule50) const
     return false;
 }
 
-void PRNG::init(uint64_t seed)
-{
-    a = 0xf1ea5eed;
-    b = c = d = seed;
-
-    for (int i = 0; i < 20; ++i)
-        rand();
-}
-
-uint64_t PRNG::rand()
-{
-    uint64_t e = a - rotate(b, 7);
-    a = b ^ rotate(c, 13);
-    b = c + rotate(d, 37);
-    c = d + e;
-    return d = e + a;
-}
-
-void init()
-{
-    PRNG prng;
-
-    for (Color c = WHITE; c <= BLACK; ++c)
-        for (Piece p = KNIGHT; p < NB_PIECE; ++p)
-            for (Square s = A1; s <= H8; ++s)
-                Zobrist[c][p][s] = prng.rand();
-
-    for (Square s = A1; s <= H8; ++s)
-        ZobristCastling[s] = prng.rand();
-
-    for (Square s = A1; s <= H8; ++s)
-        ZobristEnPassant[s] = prng.rand();
-
-    ZobristEnPassant[NB_SQUARE] = prng.rand();
-
-    ZobristTurn = prng.rand();
-}
-
 uint64_t key(Color c, Piece p, Square s)
 {
     BOUNDS(c, NB_COLOR);
     BOUNDS(p, NB_PIECE);
     BOUNDS(s, NB_SQUARE);
 
-    return Zobrist[c][p][s];
+    return T.Zobrist[c][p][s];
 }
 
 uint64_t keys(Color c, Piece p, uint64_t sqs)
@@ -131,7 +114,7 @@ uint64_t castling(bitboard_t castlableRooks)
     bitboard_t k = 0;
 
     while (castlableRooks)
-        k ^= ZobristCastling[bb::pop_lsb(castlableRooks)];
+        k ^= T.ZobristCastling[bb::pop_lsb(castlableRooks)];
 
     return k;
 }
@@ -140,12 +123,12 @@ uint64_t en_passant(Square s)
 {
     assert(unsigned(s) <= NB_SQUARE);
 
-    return ZobristEnPassant[s];
+    return T.ZobristEnPassant[s];
 }
 
 uint64_t turn()
 {
-    return ZobristTurn;
+    return T.ZobristTurn;
 }
 
 }    // namespace zobrist
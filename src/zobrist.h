@@ -6,12 +6,32 @@ namespace zobrist {
 
 class PRNG {
     uint64_t a, b, c, d;
+    static constexpr uint64_t rotate(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
 public:
-    PRNG() { init(); }
-    void init(uint64_t seed = 0);
-    uint64_t rand();
+    constexpr PRNG(): a(0), b(0), c(0), d(0) { init(); }
+    constexpr void init(uint64_t seed = 0);
+    constexpr uint64_t rand();
 };
 
+// constexpr, so that zobrist keys can be calculated at compile time
+constexpr void PRNG::init(uint64_t seed)
+{
+    a = 0xf1ea5eed;
+    b = c = d = seed;
+
+    for (int i = 0; i < 20; ++i)
+        rand();
+}
+
+constexpr uint64_t PRNG::rand()
+{
+    uint64_t e = a - rotate(b, 7);
+    a = b ^ rotate(c, 13);
+    b = c + rotate(d, 37);
+    c = d + e;
+    return d = e + a;
+}
+
 class GameStack {
     uint64_t keys[MAX_GAME_PLY];
     int idx;
@@ -23,8 +43,6 @@ public:
     bool repetition(int rule50) const;
 };
 
-void init();
-
 uint64_t key(Color c, Piece p, Square s);
 uint64_t keys(Color c, Piece p, uint64_t sqs);
 